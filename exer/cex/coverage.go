@@ -0,0 +1,137 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+
+package main
+
+// Pin coverage of a run.
+//
+// With -coverage, the link fetches (and clears) the Nano's register bit
+// coverage at the end of each vector file, and adds it to the total for
+// the file's socket. At the end of the run, the bits are mapped to the
+// pins of each socket that was used, which shows the pins the run's
+// vectors never drove both ways, or never saw driven both ways by the
+// device. The Nano keeps the bitmaps as it applies the vectors, so this
+// costs one command per file rather than the raw results of every vector.
+
+import (
+	"fmt"
+	"log"
+	"strings"
+
+	"cex/dev"
+)
+
+// A pinBit is the register bit that drives or captures a pin. Input
+// pins of the device are driven by output registers and output pins
+// are captured by input registers.
+type pinBit struct {
+	pin    int
+	reg    dev.RegisterID
+	bit    uint
+	output bool // an output of the device
+}
+
+// Add the pins first..last, which are bits bit.. of reg, to bits.
+func addPins(bits []pinBit, first, last int, reg dev.RegisterID, bit uint, output bool) []pinBit {
+	for pin := first; pin <= last; pin++ {
+		bits = append(bits, pinBit{pin, reg, bit, output})
+		bit++
+	}
+	return bits
+}
+
+// The register bits of the PLCC pins, as wired in compilePLCC().
+func plccPinBits() []pinBit {
+	var bits []pinBit
+	bits = addPins(bits, 1, 8, dev.RegU4Clk, 0, false)
+	bits = addPins(bits, 9, 16, dev.RegU5Clk, 0, false)
+	bits = addPins(bits, 20, 24, dev.RegU11Read, 0, true)
+	bits = append(bits, pinBit{25, dev.RegU8Clk, 2, false},
+		pinBit{26, dev.RegU8Clk, 1, false}, pinBit{27, dev.RegU8Clk, 0, false})
+	for pin := 28; pin <= 43; pin++ { // F, bit reversed
+		if pin < 36 {
+			bits = append(bits, pinBit{pin, dev.RegU3Read, uint(35 - pin), true})
+		} else {
+			bits = append(bits, pinBit{pin, dev.RegU7Read, uint(43 - pin), true})
+		}
+	}
+	bits = addPins(bits, 44, 48, dev.RegU8Clk, 3, false)
+	bits = addPins(bits, 49, 52, dev.RegU10Clk, 4, false)
+	bits = addPins(bits, 53, 60, dev.RegU1Clk, 0, false)
+	bits = addPins(bits, 61, 68, dev.RegU2Clk, 0, false)
+	return bits
+}
+
+// The register bits of the ZIF pins, as wired in compileZIF(). Every
+// pin but TSTCLK may be an input or an output of the device. The Nano
+// can't tell whether a group's drivers were on when it wrote or read
+// the group's bits, so this coverage is an upper bound.
+func zifPinBits() []pinBit {
+	var bits []pinBit
+	bits = addPins(bits, 2, 8, dev.RegU1Clk, 1, false)
+	bits = addPins(bits, 9, 16, dev.RegU2Clk, 0, false)
+	bits = addPins(bits, 17, 24, dev.RegU8Clk, 0, false)
+	bits = addPins(bits, 2, 8, dev.RegU3Read, 1, true)
+	bits = addPins(bits, 9, 16, dev.RegU7Read, 0, true)
+	bits = addPins(bits, 17, 24, dev.RegU11Read, 0, true)
+	return bits
+}
+
+// The coverage of a run, by socket. A nil socket wasn't used.
+type runCoverage [socketZIF + 1]*dev.Coverage
+
+// Fetch the Nano's coverage of the file just applied, which must have
+// been flushed, and add it to the socket's total.
+func (rc *runCoverage) fetch(nano *dev.Arduino, socket byte) error {
+	c, err := dev.FetchCoverage(nano, true)
+	if err != nil {
+		return err
+	}
+	if rc[socket] == nil {
+		rc[socket] = &dev.Coverage{}
+	}
+	rc[socket].Add(c)
+	return nil
+}
+
+// Log the pins of each socket used that weren't covered both ways.
+func (rc *runCoverage) report() {
+	for socket, c := range rc {
+		if c == nil {
+			continue
+		}
+		bits := plccPinBits()
+		if socket == socketZIF {
+			bits = zifPinBits()
+		}
+		var missing [2][2][]string // [output][value]
+		covered := [2]int{}
+		total := [2]int{}
+		for _, b := range bits {
+			dir := 0
+			if b.output {
+				dir = 1
+			}
+			one, zero := c.Bit(b.reg, b.bit)
+			total[dir]++
+			if one && zero {
+				covered[dir]++
+			}
+			if !zero {
+				missing[dir][0] = append(missing[dir][0], fmt.Sprint(b.pin))
+			}
+			if !one {
+				missing[dir][1] = append(missing[dir][1], fmt.Sprint(b.pin))
+			}
+		}
+		log.Printf("%s coverage: %d of %d input pins driven 0 and 1, %d of %d output pins seen 0 and 1",
+			socketNames[socket], covered[0], total[0], covered[1], total[1])
+		what := [2]string{"input pins never driven", "output pins never seen"}
+		for dir := range missing {
+			for v := range missing[dir] {
+				if len(missing[dir][v]) != 0 {
+					log.Printf("  %s %d: %s", what[dir], v, strings.Join(missing[dir][v], " "))
+				}
+			}
+		}
+	}
+}
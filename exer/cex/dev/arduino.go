@@ -23,9 +23,36 @@ const resetDelay time.Duration = 4 * time.Second
 // Types
 
 type Arduino struct {
-	port  serial.Port
-	log   *log.Logger
-	debug bool
+	port    serial.Port
+	name    string // device name
+	log     *log.Logger
+	debug   bool
+	scratch [8]byte // encoding space for single commands
+	caps    Capabilities
+	trace   *Trace // nil unless tracing
+	message []byte // frames of a log message received so far
+
+	rtt          rttStats      // round trips, for response deadlines
+	fixedTimeout time.Duration // if nonzero, the deadline for every response
+
+	// Bytes read from the port but not yet consumed. Each read from the
+	// port takes whatever has arrived, so an ack and its response are
+	// usually served from here after a single system call.
+	readBuf  [256]byte
+	readNext int // next unconsumed byte
+	readEnd  int // end of valid bytes
+}
+
+// A deadline covers an entire operation, e.g. receiving an ack and its
+// fixed response, rather than a single byte. The timeout is kept only
+// for reporting.
+type deadline struct {
+	at      time.Time
+	timeout time.Duration
+}
+
+func newDeadline(timeout time.Duration) deadline {
+	return deadline{time.Now().Add(timeout), timeout}
 }
 
 type NoResponseError time.Duration
@@ -47,6 +74,7 @@ func NewArduino(deviceName string, baudRate int, log *log.Logger, debug bool) (*
 		return nil, err
 	}
 
+	arduino.name = deviceName
 	arduino.log = log
 	arduino.debug = false // = debug FOR NOW
 	log.Printf("serial port is open - delaying %.0f seconds for Nano reset", resetDelay.Seconds())
@@ -54,9 +82,43 @@ func NewArduino(deviceName string, baudRate int, log *log.Logger, debug bool) (*
 	return &arduino, nil
 }
 
+// Put the serial port in low latency mode if the system supports it, so
+// the USB bridge doesn't hold each response for its latency timer. The
+// round trip time the session measures shows the effect.
+func (arduino *Arduino) SetLowLatency() {
+	if what, err := setLowLatency(arduino.name); err != nil {
+		log.Printf("low latency mode: %v", err)
+	} else {
+		log.Printf("low latency mode: %s", what)
+	}
+}
+
+// Return the capabilities the Arduino reported when the session was created.
+func (arduino *Arduino) Caps() *Capabilities {
+	return &arduino.caps
+}
+
+// Record spans of pipelined I/O in t, or stop recording if t is nil.
+// The Nano's records fetched into t from now on are placed on the host's
+// timeline by a clock of their own, since a Nano opened again has reset.
+func (arduino *Arduino) SetTrace(t *Trace) {
+	arduino.trace = t
+	t.newSession()
+}
+
+func (arduino *Arduino) Trace() *Trace {
+	return arduino.trace
+}
+
 // Read the Arduino until a byte is received or a timeout occurs
 func (arduino *Arduino) ReadFor(timeout time.Duration) (byte, error) {
-	return arduino.readByte(timeout)
+	return arduino.readByte(newDeadline(timeout))
+}
+
+// Read exactly len(p) bytes from the Arduino unless the timeout, which
+// applies to the whole read, occurs first.
+func (arduino *Arduino) ReadFull(p []byte, timeout time.Duration) error {
+	return arduino.readFull(p, newDeadline(timeout))
 }
 
 // Write bytes to the Arduino.
@@ -71,17 +133,51 @@ func (arduino *Arduino) Close() error {
 
 // Implementation
 
-// Read a byte
-func (arduino *Arduino) readByte(readTimeout time.Duration) (byte, error) {
-	b := make([]byte, 1, 1)
+// Read a byte, from the read buffer if possible, else by refilling it.
+func (arduino *Arduino) readByte(dl deadline) (byte, error) {
+	if arduino.readNext == arduino.readEnd {
+		if err := arduino.fill(dl); err != nil {
+			return 0, err
+		}
+	}
+	b := arduino.readBuf[arduino.readNext]
+	arduino.readNext++
+	return b, nil
+}
+
+// Read len(p) bytes, refilling the read buffer as often as required.
+func (arduino *Arduino) readFull(p []byte, dl deadline) error {
+	for len(p) > 0 {
+		if arduino.readNext == arduino.readEnd {
+			if err := arduino.fill(dl); err != nil {
+				return err
+			}
+		}
+		n := copy(p, arduino.readBuf[arduino.readNext:arduino.readEnd])
+		arduino.readNext += n
+		p = p[n:]
+	}
+	return nil
+}
+
+// Refill the empty read buffer with whatever bytes the port has, waiting
+// until the deadline for at least one to arrive.
+func (arduino *Arduino) fill(dl deadline) error {
 	var n int
 	var err error
 
+	arduino.readNext = 0
+	arduino.readEnd = 0
+	remaining := time.Until(dl.at)
+	if remaining <= 0 {
+		return NoResponseError(dl.timeout)
+	}
+
 	// The for-loop is -solely- to handle EINTR, which occurs constantly
 	// as a result of Golang's Goroutine-level context switching mechanism.
-	arduino.port.SetReadTimeout(readTimeout)
+	arduino.port.SetReadTimeout(remaining)
 	for {
-		n, err = arduino.port.Read(b)
+		n, err = arduino.port.Read(arduino.readBuf[:])
 		// Break loop unless EINTR.
 		if !isRetryableSyscallError(err) {
 			break
@@ -91,12 +187,13 @@ func (arduino *Arduino) readByte(readTimeout time.Duration) (byte, error) {
 		}
 	}
 	if err != nil {
-		return 0, err
+		return err
 	}
 	if n == 0 {
-		return 0, NoResponseError(readTimeout)
+		return NoResponseError(dl.timeout)
 	}
-	return b[0], nil
+	arduino.readEnd = n
+	return nil
 }
 
 // Write bytes
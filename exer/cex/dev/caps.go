@@ -0,0 +1,98 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+
+package dev
+
+// Device capabilities.
+//
+// Since protocol v14, the firmware answers CmdGetCaps with a counted
+// response describing its buffering and the optional features it
+// supports. The host reads it once per session and uses it to decide
+// how to drive the device, e.g. how far the pipeline may write ahead.
+// Firmware older than v14 doesn't have the command; it gets the
+// capabilities that v13 is known to have.
+
+import (
+	"encoding/binary"
+	"fmt"
+	"log"
+)
+
+type Capabilities struct {
+	Version    byte   // protocol version of the firmware
+	Bits       uint16 // Cap... bits
+	RcvRing    int    // size of the firmware's receive ring
+	RxBuffer   int    // size of the Arduino core's receive buffer
+	MaxCmd     int    // largest fixed command
+	MaxPayload int    // largest counted response
+	Baud       int    // baud rate of the firmware
+}
+
+// What protocol v13 firmware has, which it can't report.
+var v13Capabilities = Capabilities{
+	Version:    13,
+	Bits:       CapPipeline,
+	RcvRing:    16,
+	RxBuffer:   64,
+	MaxCmd:     8,
+	MaxPayload: 255,
+	Baud:       115200,
+}
+
+func (c *Capabilities) Has(bits uint16) bool {
+	return c.Bits&bits == bits
+}
+
+// Return the pipeline window for the device. Bytes the firmware hasn't
+// processed sit in the core's receive buffer and then in the receive
+// ring. The serial task only moves bytes from one to the other when it
+// runs, so the window is limited by the core buffer alone, with a
+// margin. Without pipelining, the window allows one command at a time.
+func (c *Capabilities) Window() int {
+	if !c.Has(CapPipeline) {
+		return c.MaxCmd
+	}
+	w := c.RxBuffer * 3 / 4
+	if w < c.MaxCmd {
+		w = c.MaxCmd
+	}
+	return w
+}
+
+func (c *Capabilities) String() string {
+	return fmt.Sprintf("protocol v%d, capabilities 0x%04X, receive buffers %d+%d, window %d, %d baud",
+		c.Version, c.Bits, c.RxBuffer, c.RcvRing, c.Window(), c.Baud)
+}
+
+// Return the capabilities of the device, which must have already
+// reported the given protocol version.
+func getCapabilities(nano *Arduino, version byte) (Capabilities, error) {
+	if version < 14 {
+		return v13Capabilities, nil
+	}
+	b, err := DoCountedReceive(nano, []byte{CmdGetCaps})
+	if err != nil {
+		return Capabilities{}, err
+	}
+	if len(b) < CapsSize {
+		return Capabilities{}, fmt.Errorf("capabilities response too short (%d bytes)", len(b))
+	}
+	caps := Capabilities{
+		Version:    b[CapsVersion],
+		Bits:       binary.LittleEndian.Uint16(b[CapsBits:]),
+		RcvRing:    int(b[CapsRcvRing]),
+		RxBuffer:   int(b[CapsRxBuffer]),
+		MaxCmd:     int(b[CapsMaxCmd]),
+		MaxPayload: int(b[CapsMaxPayload]),
+		Baud:       100 * int(binary.LittleEndian.Uint16(b[CapsBaud:])),
+	}
+	if caps.Version != version {
+		return caps, fmt.Errorf("capabilities report protocol v%d, expected v%d", caps.Version, version)
+	}
+	if caps.RxBuffer < minWindow {
+		return caps, fmt.Errorf("unusable capabilities: %s", caps.String())
+	}
+	if nano.debug {
+		log.Printf("capabilities: % X\n", b)
+	}
+	return caps, nil
+}
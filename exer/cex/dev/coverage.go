@@ -0,0 +1,58 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+
+package dev
+
+// Register bit coverage.
+//
+// Since protocol v19, the Nano keeps a pair of bitmaps for each register
+// ID: the bits it has written to or read from the register as one, and
+// as zero. Since the bits of the data registers run to pins of the
+// sockets, they tell which pins a suite of vectors has driven, or seen
+// driven, both ways, without the host having to keep the raw results.
+// The bits are as they are on the wires, so a bit-reversed set or get
+// covers the bits the register actually held.
+
+import (
+	"fmt"
+)
+
+type Coverage struct {
+	Ones  [MaxRegisterID + 1]byte // bits seen one
+	Zeros [MaxRegisterID + 1]byte // bits seen zero
+}
+
+// Fetch the Nano's coverage bitmaps, and clear them if clear is true.
+// Pipelines must be flushed.
+func FetchCoverage(nano *Arduino, clear bool) (*Coverage, error) {
+	if !nano.caps.Has(CapCoverage) {
+		return nil, fmt.Errorf("the Arduino firmware doesn't keep coverage")
+	}
+	var arg byte
+	if clear {
+		arg = CoverClear
+	}
+	b, err := DoCountedReceive(nano, []byte{CmdCoverage, arg})
+	if err != nil {
+		return nil, err
+	}
+	if len(b) != CoverSize {
+		return nil, fmt.Errorf("bad coverage response length %d", len(b))
+	}
+	c := &Coverage{}
+	copy(c.Ones[:], b[CoverOnes:])
+	copy(c.Zeros[:], b[CoverZeros:])
+	return c, nil
+}
+
+// Add the bits of o to c.
+func (c *Coverage) Add(o *Coverage) {
+	for i := range c.Ones {
+		c.Ones[i] |= o.Ones[i]
+		c.Zeros[i] |= o.Zeros[i]
+	}
+}
+
+// Return whether bit of register id has been seen one and seen zero.
+func (c *Coverage) Bit(id RegisterID, bit uint) (one bool, zero bool) {
+	return c.Ones[id]&(1<<bit) != 0, c.Zeros[id]&(1<<bit) != 0
+}
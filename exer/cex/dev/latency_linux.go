@@ -0,0 +1,110 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+
+//go:build linux
+
+package dev
+
+// Low latency mode for USB serial bridges on Linux.
+//
+// An FTDI bridge holds received bytes for up to its latency timer, 16ms
+// by default, before sending a short packet to the host, so every round
+// trip of the protocol waits for it. The ftdi_sio driver exposes the
+// timer in sysfs, and sets it to 1ms when the port has ASYNC_LOW_LATENCY.
+// Other drivers accept the flag and may or may not do anything with it.
+
+import (
+	"fmt"
+	"os"
+	"path/filepath"
+	"strconv"
+	"strings"
+	"syscall"
+	"unsafe"
+)
+
+const tiocgserial = 0x541E
+const tiocsserial = 0x541F
+const asyncLowLatency = 1 << 13
+
+// The flags of struct serial_struct are at the same offset on every
+// Linux architecture. The buffer is larger than the struct anywhere.
+const serialStructFlags = 16
+
+type serialStruct [128]byte
+
+func (s *serialStruct) flags() uint32 {
+	return *(*uint32)(unsafe.Pointer(&s[serialStructFlags]))
+}
+
+func (s *serialStruct) setFlags(f uint32) {
+	*(*uint32)(unsafe.Pointer(&s[serialStructFlags])) = f
+}
+
+// Put the serial device in low latency mode, and return what was done.
+func setLowLatency(deviceName string) (string, error) {
+	path, err := filepath.EvalSymlinks(deviceName)
+	if err != nil {
+		return "", err
+	}
+	timer := filepath.Join("/sys/bus/usb-serial/devices", filepath.Base(path), "latency_timer")
+	if old, err := readLatencyTimer(timer); err == nil {
+		if old <= 1 {
+			return fmt.Sprintf("latency timer is %dms", old), nil
+		}
+		if err := os.WriteFile(timer, []byte("1"), 0); err == nil {
+			if now, err := readLatencyTimer(timer); err == nil && now <= 1 {
+				return fmt.Sprintf("latency timer %dms -> %dms", old, now), nil
+			}
+		}
+		// Not writable by this user; try the flag, which the driver
+		// applies to the timer itself.
+	}
+	return setAsyncLowLatency(path, timer)
+}
+
+func readLatencyTimer(timer string) (int, error) {
+	b, err := os.ReadFile(timer)
+	if err != nil {
+		return 0, err
+	}
+	return strconv.Atoi(strings.TrimSpace(string(b)))
+}
+
+// Set ASYNC_LOW_LATENCY with TIOCSSERIAL, which any user who can open
+// the port may do, and read it back. The flag belongs to the port, so
+// setting it through a second descriptor doesn't disturb the first one.
+func setAsyncLowLatency(path string, timer string) (string, error) {
+	f, err := os.OpenFile(path, os.O_RDWR|syscall.O_NOCTTY|syscall.O_NONBLOCK, 0)
+	if err != nil {
+		return "", err
+	}
+	defer f.Close()
+	var ss serialStruct
+	if err := serialIoctl(f, tiocgserial, &ss); err != nil {
+		return "", fmt.Errorf("%s: %w", path, err)
+	}
+	if ss.flags()&asyncLowLatency == 0 {
+		ss.setFlags(ss.flags() | asyncLowLatency)
+		if err := serialIoctl(f, tiocsserial, &ss); err != nil {
+			return "", fmt.Errorf("%s: %w", path, err)
+		}
+		if err := serialIoctl(f, tiocgserial, &ss); err != nil {
+			return "", fmt.Errorf("%s: %w", path, err)
+		}
+		if ss.flags()&asyncLowLatency == 0 {
+			return "", fmt.Errorf("%s: the driver didn't keep ASYNC_LOW_LATENCY", path)
+		}
+	}
+	if now, err := readLatencyTimer(timer); err == nil {
+		return fmt.Sprintf("ASYNC_LOW_LATENCY set, latency timer %dms", now), nil
+	}
+	return "ASYNC_LOW_LATENCY set", nil
+}
+
+func serialIoctl(f *os.File, req uintptr, ss *serialStruct) error {
+	_, _, errno := syscall.Syscall(syscall.SYS_IOCTL, f.Fd(), req, uintptr(unsafe.Pointer(ss)))
+	if errno != 0 {
+		return errno
+	}
+	return nil
+}
@@ -0,0 +1,15 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+
+//go:build !linux
+
+package dev
+
+import (
+	"fmt"
+)
+
+// Low latency mode is only set on Linux. On macOS, the FTDI latency
+// timer is set by the driver's configuration, not at run time.
+func setLowLatency(deviceName string) (string, error) {
+	return "", fmt.Errorf("not supported on this system")
+}
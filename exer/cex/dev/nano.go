@@ -51,12 +51,24 @@ func establishConnection(nano *Arduino, wasReset bool) error {
 	if err := getSyncResponse(nano); err != nil {
 		return err
 	}
-	if err := checkProtocolVersion(nano); err != nil {
+	version, err := checkProtocolVersion(nano)
+	if err != nil {
 		return err
 	}
 	if nano.debug {
 		log.Println("protocol version OK")
 	}
+	if nano.caps, err = getCapabilities(nano, version); err != nil {
+		return err
+	}
+	log.Printf("Arduino: %s", nano.caps.String())
+	for i := 0; i < rttCalibrations; i++ {
+		if err := DoCommand(nano, CmdSync); err != nil {
+			return err
+		}
+	}
+	log.Printf("Arduino: round trip %v (max %v), response margin %v", nano.rtt.srtt.Round(time.Microsecond),
+		nano.rtt.max.Round(time.Microsecond), nano.rtt.margin().Round(time.Microsecond))
 	return nil
 }
 
@@ -64,10 +76,12 @@ func establishConnection(nano *Arduino, wasReset bool) error {
 // and that many data bytes in response to any command. Also, it shouldn't go
 // for more than a millisecond or so (really much less) without transmitting
 // if it has anything to transmit. So we read up to 257 + fudge factor bytes,
-// giving it 10mS each. If it's still transmitting, return an error.
+// until the link has been quiet for as long as a response could take. If it's
+// still transmitting, return an error.
 func drain(nano *Arduino) error {
+	quiet := nano.quietTime()
 	for i := 0; i < 300; i++ {
-		if _, err := nano.ReadFor(responseDelay); err != nil {
+		if _, err := nano.ReadFor(quiet); err != nil {
 			log.Println("Nano is drained")
 			return nil
 		}
@@ -88,7 +102,7 @@ func getSyncResponse(nano *Arduino) error {
 			log.Printf("sync command failed: %s\n", err.Error())
 		} else {
 			for nSent--; nSent > 0; nSent-- {
-				nano.ReadFor(responseDelay)
+				nano.ReadFor(nano.quietTime())
 			}
 			return nil // success
 		}
@@ -98,25 +112,50 @@ func getSyncResponse(nano *Arduino) error {
 	return fmt.Errorf("failed to synchronize")
 }
 
-func checkProtocolVersion(nano *Arduino) error {
+// Return the Arduino's protocol version, which may be older than the
+// host's. Optional features of newer versions are only used if the
+// capabilities say so.
+func checkProtocolVersion(nano *Arduino) (byte, error) {
 	var nanoCmd []byte = []byte{CmdGetVer}
 	b, err := DoFixedCommand(nano, nanoCmd, 1)
 	if err != nil {
-		return err
+		return 0, err
 	}
-	if b[0] != ProtocolVersion {
-		return fmt.Errorf("protocol version mismatch: host 0x%02X, Arduino 0x%02X\n",
-			ProtocolVersion, b[0])
+	if b[0] < ProtocolMinVersion || b[0] > ProtocolVersion {
+		return 0, fmt.Errorf("protocol version mismatch: host 0x%02X (min 0x%02X), Arduino 0x%02X\n",
+			ProtocolVersion, ProtocolMinVersion, b[0])
 	}
-	return nil
+	return b[0], nil
 }
 
+// Return the next request from the Nano, or an empty string if there's
+// none. Since protocol v18 requests arrive in frames, one per poll, and
+// this returns an empty string until the last frame of one has arrived.
+// A frame with a zero count ends a request that was cut short.
 func getNanoRequest(nano *Arduino) (string, error) {
-	bytes, err := DoCountedReceive(nano, []byte{CmdPoll})
+	if !nano.caps.Has(CapLogFrames) {
+		bytes, err := DoCountedReceive(nano, []byte{CmdPoll})
+		if err != nil {
+			return "", err
+		}
+		return string(bytes), nil
+	}
+
+	count, err := DoFixedCommand(nano, []byte{CmdPoll}, 1)
 	if err != nil {
 		return "", err
 	}
-	return string(bytes), nil
+	frame := make([]byte, count[0]&LogCount)
+	if err = nano.readFull(frame, nano.responseDeadline(len(frame), 0)); err != nil {
+		return "", err
+	}
+	nano.message = append(nano.message, frame...)
+	if count[0]&LogMore != 0 {
+		return "", nil
+	}
+	msg := string(nano.message)
+	nano.message = nano.message[:0]
+	return msg, nil
 }
 
 func DoPoll(nano *Arduino) error {
@@ -165,8 +204,8 @@ func DoCommand(nano *Arduino, cmd byte) error {
 	return err
 }
 
-func getAck(nano *Arduino, cmd byte) error {
-	b, err := nano.ReadFor(responseDelay)
+func getAck(nano *Arduino, cmd byte, dl deadline) error {
+	b, err := nano.readByte(dl)
 	if err != nil {
 		return err
 	}
@@ -209,27 +248,35 @@ func DoFixedCommand(nano *Arduino, fixed []byte, expected int) ([]byte, error) {
 		// Don't debug poll commands - there are too many
 		log.Printf("DoFixedCommand: sending %v\n", fixed)
 	}
+	if expected > 0 {
+		response = make([]byte, expected, expected)
+	}
+	// If doFixed() returns an error, the state of the
+	// response slice is undefined as described above
+	return response, doFixed(nano, fixed, response)
+}
+
+// Do the fixed part of a command as described for DoFixedCommand(), reading
+// len(response) fixed response bytes into the caller's slice. This does not
+// allocate, so it's used on the vector path. The ack and the response are
+// subject to a single deadline, and are normally read from the port with
+// one system call.
+func doFixed(nano *Arduino, fixed []byte, response []byte) error {
+	start := time.Now()
 	if err := nano.Write(fixed); err != nil {
-		return response, err
+		return err
 	}
-	if err := getAck(nano, fixed[0]); err != nil {
-		return response, err
+	n := len(fixed) + 1 + len(response)
+	work := commandWork(fixed)
+	dl := nano.responseDeadline(n, work)
+	if err := getAck(nano, fixed[0], dl); err != nil {
+		return err
 	}
-
-	if expected > 0 {
-		response = make([]byte, expected, expected)
-		for i := 0; i < expected; i++ {
-			b, err := nano.ReadFor(responseDelay)
-			if err != nil {
-				// If we encounter an error here,
-				// the state of the response slice
-				// is undefined as described above
-				return response, err
-			}
-			response[i] = b
-		}
+	if err := nano.readFull(response, dl); err != nil {
+		return err
 	}
-	return response, nil
+	nano.sampleRoundTrip(start, n, work)
+	return nil
 }
 
 // Send a counted set of bytes to the Nano. The count must be in the last
@@ -271,15 +318,6 @@ func DoCountedReceive(nano *Arduino, fixed []byte) ([]byte, error) {
 		log.Printf("Receive %d\n", count)
 	}
 	response := make([]byte, count, count)
-	for i := 0; i < int(count); i++ {
-		response[i] = byte(i)
-	}
-	for i := 0; i < int(count); i++ {
-		b, err := nano.ReadFor(responseDelay)
-		if err != nil {
-			return response, err
-		}
-		response[i] = b
-	}
-	return response, nil
+	err = nano.readFull(response, nano.responseDeadline(int(count), 0))
+	return response, err
 }
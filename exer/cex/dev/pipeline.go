@@ -0,0 +1,232 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+
+package dev
+
+// Pipelined command execution.
+//
+// DoFixedCommand() and DoCommandBuffer() write one command and wait for
+// its ack and response before writing the next, so a vector costs about
+// a dozen round trips on the USB serial link. The firmware acks every
+// command, in order, and the fixed response of a command immediately
+// follows its ack. So the host may write ahead and match acks and
+// responses to commands in FIFO order, provided it never has more bytes
+// outstanding than the Nano can buffer. That limit is the window.
+//
+// The Nano has no flow control. Bytes it has not yet processed sit in
+// the Arduino core's 64-byte receive buffer and then in the serial task's
+// receive ring. The window must stay safely below the first of these; see
+// also CHUNK_SIZE in the firmware.
+//
+// A Pipeline has exclusive use of the Arduino while commands are in flight.
+// Call Flush() before using any of the synchronous functions (DoPoll(),
+// DoFixedCommand(), etc.) on the same Arduino.
+
+import (
+	"fmt"
+	"log"
+	"time"
+)
+
+// The default number of command bytes that may be written but not yet
+// answered by the Nano.
+const DefaultWindow = 48
+
+// The smallest usable window is the largest fixed command.
+const minWindow = 8
+
+// A Completion receives the fixed responses of all the commands in one
+// submitted CommandBuffer, in order, after the last of them has been
+// answered. On error, results is nil. The results slice is only valid
+// during the call.
+type Completion interface {
+	Complete(results []byte, err error)
+}
+
+// CompletionFunc allows an ordinary function to be used as a Completion.
+type CompletionFunc func(results []byte, err error)
+
+func (f CompletionFunc) Complete(results []byte, err error) {
+	f(results, err)
+}
+
+type pipelinedCommand struct {
+	cmd     byte
+	cmdLen  int
+	respLen int
+	done    Completion // non-nil only for the last command of a submission
+}
+
+type Pipeline struct {
+	nano     *Arduino
+	window   int                // maximum command bytes in flight
+	inFlight int                // command bytes written but not yet answered
+	queue    []pipelinedCommand // commands not yet answered, oldest first
+	head     int                // oldest entry in queue
+	written  int                // entries of the queue, from head, written
+	out      []byte             // encoded commands not yet written
+	results  []byte             // responses so far for the oldest submission
+	err      error              // once set, the pipeline is dead
+}
+
+// Create a pipeline on the Arduino allowing up to window bytes of commands
+// in flight. A window of 0 selects DefaultWindow.
+func NewPipeline(nano *Arduino, window int) *Pipeline {
+	if window == 0 {
+		window = DefaultWindow
+	}
+	if window < minWindow {
+		window = minWindow
+	}
+	return &Pipeline{
+		nano:    nano,
+		window:  window,
+		queue:   make([]pipelinedCommand, 0, 64),
+		out:     make([]byte, 0, 2*window),
+		results: make([]byte, 0, 16),
+	}
+}
+
+// Queue the commands in cb for transmission and return without waiting
+// for them to be answered, unless the window is full. The commands are
+// copied, so cb may be reused immediately. The done Completion is called
+// when the last of the commands has been answered, or when the pipeline
+// fails. Completions are called in submission order. Once any error has
+// occurred, every call returns it and the session should be recreated.
+func (p *Pipeline) Submit(cb *CommandBuffer, done Completion) error {
+	if p.err != nil {
+		return p.err
+	}
+	cmds := cb.Bytes()
+	if len(cmds) == 0 {
+		// Nothing to send, but the completion must still
+		// be ordered after those of earlier submissions.
+		if err := p.Flush(); err != nil {
+			return err
+		}
+		done.Complete(p.results[:0], nil)
+		return nil
+	}
+
+	for rest := cmds; len(rest) > 0; {
+		cmdLen, respLen := exerciserCommandLengths(rest)
+		if cmdLen == 0 || cmdLen > len(rest) {
+			return p.fail(fmt.Errorf("internal error: bad command buffer at 0x%02X", rest[0]))
+		}
+		if cmdLen > p.window {
+			return p.fail(fmt.Errorf("internal error: %d byte command exceeds the window", cmdLen))
+		}
+		p.queue = append(p.queue, pipelinedCommand{rest[0], cmdLen, respLen, nil})
+		rest = rest[cmdLen:]
+	}
+	p.queue[len(p.queue)-1].done = done
+	p.out = append(p.out, cmds...)
+
+	// Write as much as the window allows. If there are still unwritten
+	// commands, wait for answers to make room for them.
+	for {
+		if err := p.writeAhead(); err != nil {
+			return err
+		}
+		if p.head+p.written == len(p.queue) {
+			return nil
+		}
+		if err := p.completeOldest(); err != nil {
+			return err
+		}
+	}
+}
+
+// Wait until every submitted command has been answered.
+func (p *Pipeline) Flush() error {
+	for p.err == nil && p.head < len(p.queue) {
+		if err := p.writeAhead(); err != nil {
+			return err
+		}
+		if err := p.completeOldest(); err != nil {
+			return err
+		}
+	}
+	return p.err
+}
+
+// Write as many unwritten commands as will fit in the window, using a
+// single write.
+func (p *Pipeline) writeAhead() error {
+	n := 0
+	for i := p.head + p.written; i < len(p.queue); i++ {
+		c := &p.queue[i]
+		if p.inFlight+c.cmdLen > p.window {
+			break
+		}
+		p.inFlight += c.cmdLen
+		p.written++
+		n += c.cmdLen
+	}
+	if n == 0 {
+		return nil
+	}
+	if p.nano.debug {
+		log.Printf("Pipeline: sending % X\n", p.out[:n])
+	}
+	start := time.Now()
+	if err := p.nano.Write(p.out[:n]); err != nil {
+		return p.fail(err)
+	}
+	p.nano.trace.Span(TraceLink, "write", "", start)
+	p.out = p.out[:copy(p.out, p.out[n:])]
+	return nil
+}
+
+// Wait for the ack and fixed response of the oldest written command.
+func (p *Pipeline) completeOldest() error {
+	if p.written == 0 {
+		return p.fail(fmt.Errorf("internal error: pipeline has nothing in flight"))
+	}
+	c := &p.queue[p.head]
+	start := time.Now()
+	// Every command written may be ahead of the ack on the wire.
+	dl := p.nano.responseDeadline(p.inFlight+1+c.respLen, 0)
+	if err := getAck(p.nano, c.cmd, dl); err != nil {
+		return p.fail(err)
+	}
+	n := len(p.results)
+	for i := 0; i < c.respLen; i++ {
+		p.results = append(p.results, 0)
+	}
+	if err := p.nano.readFull(p.results[n:], dl); err != nil {
+		return p.fail(err)
+	}
+	p.nano.trace.Span(TraceLink, "wait", commandName(c.cmd), start)
+
+	done := c.done
+	p.inFlight -= c.cmdLen
+	p.written--
+	p.head++
+	if p.head == len(p.queue) {
+		p.queue = p.queue[:0]
+		p.head = 0
+	}
+	if done != nil {
+		results := p.results
+		p.results = p.results[:0]
+		done.Complete(results, nil)
+	}
+	return nil
+}
+
+// Record a fatal error and fail every submission that has not completed.
+func (p *Pipeline) fail(err error) error {
+	p.err = err
+	for i := p.head; i < len(p.queue); i++ {
+		if p.queue[i].done != nil {
+			p.queue[i].done.Complete(nil, err)
+		}
+	}
+	p.queue = p.queue[:0]
+	p.head = 0
+	p.written = 0
+	p.inFlight = 0
+	p.out = p.out[:0]
+	p.results = p.results[:0]
+	return err
+}
@@ -0,0 +1,285 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+
+package dev
+
+// Typed register operations for the chip exerciser.
+//
+// The interactive t, s, and g commands are convenient for poking at the
+// hardware, but formatting a command as text only to parse it again costs
+// more host time per vector than the Nano spends executing it. Here the
+// operations are encoded directly into a reusable CommandBuffer and sent
+// from there without further allocation. The interactive commands are a
+// thin front end over the same functions.
+
+import (
+	"fmt"
+	"log"
+)
+
+// A RegisterID is the "as wired" index (0..15) of one of the sixteen pulse
+// outputs of the exerciser's decoders. The names follow the ID assignment
+// table in the README in the parent directory.
+type RegisterID byte
+
+const (
+	RegU3Clk   RegisterID = 0x0 // Clocks input register U3
+	RegU3Read  RegisterID = 0x1 // Reads value of input register U3
+	RegU2Clk   RegisterID = 0x2 // Clocks output register U2
+	RegU1Clk   RegisterID = 0x3 // Clocks output register U1
+	RegU4Clk   RegisterID = 0x4 // Clocks output register U4
+	RegU5Clk   RegisterID = 0x5 // Clocks output register U5
+	RegU8Clk   RegisterID = 0x6 // Clocks output register U8
+	RegU7Clk   RegisterID = 0x7 // Clocks input register U7
+	RegTstClk  RegisterID = 0x8 // TSTCLK to PLCC pin 17 and ZIF pin 1
+	RegU7Read  RegisterID = 0x9 // Reads value of input register U7
+	RegU10Clk  RegisterID = 0xA // Clocks output register U10
+	RegU11Clk  RegisterID = 0xB // Clocks input register U11
+	RegU11Read RegisterID = 0xC // Reads value of input register U11
+	RegU14Clk  RegisterID = 0xD // Clocks output register U14 (not implemented)
+
+	MaxRegisterID RegisterID = 0xF
+)
+
+// Return the length of the exerciser command at the start of cmd,
+// including the command byte and any bytes counted by it, and the length
+// of its fixed response not including the ack. These must agree with the
+// handler table in the firmware. The lengths of CmdLoad and CmdReplay
+// are in their second byte; if it's missing, the length is 0.
+func exerciserCommandLengths(cmd []byte) (int, int) {
+	switch cmd[0] {
+	case CmdPulse, CmdSet, CmdSetR:
+		return 3, 0
+	case CmdGet, CmdGetR:
+		return 2, 1
+	case CmdLayout:
+		return 3, 0
+	case CmdApply:
+		return 2 + LayoutNWrites, ApplyResults
+	case CmdClocks:
+		return 1 + 2*ClockPhases, ClockResults
+	case CmdCheckpoint:
+		return 1, CheckpointSize
+	case CmdLoad:
+		if len(cmd) > 1 {
+			return 2 + int(cmd[1]), 0
+		}
+	case CmdReplay:
+		if len(cmd) > 1 {
+			return 2, int(cmd[1])
+		}
+	}
+	return 0, 0
+}
+
+// A CommandBuffer holds a sequence of encoded exerciser commands. It is
+// intended to be Reset() and refilled for each vector so that applying a
+// vector does not allocate once the buffer has grown to its working size.
+type CommandBuffer struct {
+	buf       []byte // encoded commands, back to back
+	commands  int    // number of commands
+	responses int    // number of fixed response bytes the commands return
+}
+
+func NewCommandBuffer() *CommandBuffer {
+	return &CommandBuffer{buf: make([]byte, 0, 64)}
+}
+
+// Discard the commands but keep the storage.
+func (cb *CommandBuffer) Reset() {
+	cb.buf = cb.buf[:0]
+	cb.commands = 0
+	cb.responses = 0
+}
+
+// Return the encoded commands. The slice is only valid until the
+// next change to the buffer.
+func (cb *CommandBuffer) Bytes() []byte {
+	return cb.buf
+}
+
+// Return the number of commands in the buffer.
+func (cb *CommandBuffer) Commands() int {
+	return cb.commands
+}
+
+// Return the number of response bytes the commands will return.
+func (cb *CommandBuffer) Responses() int {
+	return cb.responses
+}
+
+// Pulse the control output id low then high count times.
+func (cb *CommandBuffer) Pulse(id RegisterID, count byte) {
+	cb.buf = append(cb.buf, CmdPulse, count, byte(id))
+	cb.commands++
+}
+
+// Set the output register id to data.
+func (cb *CommandBuffer) Set(id RegisterID, data byte) {
+	cb.buf = append(cb.buf, CmdSet, byte(id), data)
+	cb.commands++
+}
+
+// Like Set() but the Nano bit reverses the data before writing it.
+func (cb *CommandBuffer) SetReversed(id RegisterID, data byte) {
+	cb.buf = append(cb.buf, CmdSetR, byte(id), data)
+	cb.commands++
+}
+
+// Get the input register id, which must have been clocked previously.
+// The value is returned in order with the results of other gets.
+func (cb *CommandBuffer) Get(id RegisterID) {
+	cb.buf = append(cb.buf, CmdGet, byte(id))
+	cb.commands++
+	cb.responses++
+}
+
+// Like Get() but the Nano bit reverses the value before returning it.
+func (cb *CommandBuffer) GetReversed(id RegisterID) {
+	cb.buf = append(cb.buf, CmdGetR, byte(id))
+	cb.commands++
+	cb.responses++
+}
+
+// Set slot of the Nano's vector layout to register id, or to LayoutNone
+// if id is greater than MaxRegisterID. The flags are LayoutReversed and,
+// for a write slot holding active low output enables, LayoutEnables. See
+// Apply().
+func (cb *CommandBuffer) Layout(slot int, id RegisterID, flags byte) {
+	b := byte(LayoutNone)
+	if id <= MaxRegisterID {
+		b = byte(id) | flags
+	}
+	cb.buf = append(cb.buf, CmdLayout, byte(slot), b)
+	cb.commands++
+}
+
+// Apply one vector with a single command, using the registers given by
+// the layout: write data to the output registers (skipping those that
+// hold it already unless ctl has ApplyWriteAll, and all of them if it
+// has ApplyNoWrites; output enables are turned off before the other
+// writes and on after them), pulse the clock if ctl has ApplyClock, and capture
+// and read the input registers in the ApplyReads bits of ctl. The
+// ApplyResults response bytes hold the values read, packed in slot
+// order. With ApplyPipelined, they are instead the values captured by
+// the previous pipelined Apply(), and this vector's come back with the
+// next. A pipelined Apply() with only ApplyNoWrites flushes them.
+func (cb *CommandBuffer) Apply(ctl byte, data *[LayoutNWrites]byte) {
+	cb.buf = append(cb.buf, CmdApply, ctl)
+	cb.buf = append(cb.buf, data[:]...)
+	cb.commands++
+	cb.responses += ApplyResults
+}
+
+// One phase of a Clocks() command: pulse register ID Count times, then
+// capture and read the input registers in Reads, as in ApplyReads.
+type ClockPhase struct {
+	ID    RegisterID
+	Count byte
+	Reads byte
+}
+
+// Run the clock phases of a vector whose inputs have been written, in a
+// single command. The capture and read registers are those of the
+// layout. The ClockResults response bytes hold the values read, those
+// of phase i packed in slot order at byte i*ApplyResults. The results
+// of a pipelined Apply() must have been flushed.
+func (cb *CommandBuffer) Clocks(phases []ClockPhase) {
+	cb.buf = append(cb.buf, CmdClocks)
+	for i := 0; i < ClockPhases; i++ {
+		if i < len(phases) {
+			p := &phases[i]
+			cb.buf = append(cb.buf, byte(p.ID)|p.Reads<<ClockReadsShift, p.Count)
+		} else {
+			cb.buf = append(cb.buf, 0, 0)
+		}
+	}
+	cb.commands++
+	cb.responses += ClockResults
+}
+
+// Add the vectors in stream, a piece of the compressed stream described
+// in the firmware's serial_protocol.h, to the Nano's vector table. The
+// Nano acks the command after it has taken the last byte, so the whole
+// command counts against the pipeline window until then. See VectorTable.
+func (cb *CommandBuffer) Load(stream []byte) {
+	cb.buf = append(cb.buf, CmdLoad, byte(len(stream)))
+	cb.buf = append(cb.buf, stream...)
+	cb.commands++
+}
+
+// Apply the vectors of the Nano's vector table and empty it. The
+// response is the results of each vector's reads, packed one vector
+// after another; there must be n of them in all.
+func (cb *CommandBuffer) Replay(n int) {
+	cb.buf = append(cb.buf, CmdReplay, byte(n))
+	cb.commands++
+	cb.responses += n
+}
+
+// Report the vectors applied since the last Checkpoint() and the data
+// in the output registers of the layout. The CheckpointSize response
+// bytes are as described in the firmware's serial_protocol.h.
+func (cb *CommandBuffer) Checkpoint() {
+	cb.buf = append(cb.buf, CmdCheckpoint)
+	cb.commands++
+	cb.responses += CheckpointSize
+}
+
+// Send each command in the buffer to the Nano in order and wait for its
+// ack and fixed response, if any. The responses of all the gets are
+// appended to results, which is returned. If the capacity of results is
+// at least cb.Responses(), nothing is allocated.
+func DoCommandBuffer(nano *Arduino, cb *CommandBuffer, results []byte) ([]byte, error) {
+	for cmd := cb.buf; len(cmd) > 0; {
+		cmdLen, respLen := exerciserCommandLengths(cmd)
+		if cmdLen == 0 || cmdLen > len(cmd) {
+			return results, fmt.Errorf("internal error: bad command buffer at 0x%02X", cmd[0])
+		}
+		if nano.debug {
+			log.Printf("DoCommandBuffer: sending % X\n", cmd[:cmdLen])
+		}
+		n := len(results)
+		for i := 0; i < respLen; i++ {
+			results = append(results, 0)
+		}
+		if err := doFixed(nano, cmd[:cmdLen], results[n:]); err != nil {
+			return results, err
+		}
+		cmd = cmd[cmdLen:]
+	}
+	return results, nil
+}
+
+// Single operations, used by the interactive commands. These encode
+// into the Arduino's scratch buffer rather than allocating.
+
+// Pulse the control output id low then high count times.
+func Pulse(nano *Arduino, id RegisterID, count byte) error {
+	cmd := append(nano.scratch[:0], CmdPulse, count, byte(id))
+	return doFixed(nano, cmd, nil)
+}
+
+// Set the output register id to data, bit reversed if reversed is true.
+func SetRegister(nano *Arduino, id RegisterID, data byte, reversed bool) error {
+	var cmdByte byte = CmdSet
+	if reversed {
+		cmdByte = CmdSetR
+	}
+	cmd := append(nano.scratch[:0], cmdByte, byte(id), data)
+	return doFixed(nano, cmd, nil)
+}
+
+// Get the value of input register id, bit reversed if reversed is true.
+// The register must have been clocked by a previous Pulse().
+func GetRegister(nano *Arduino, id RegisterID, reversed bool) (byte, error) {
+	var cmdByte byte = CmdGet
+	if reversed {
+		cmdByte = CmdGetR
+	}
+	cmd := append(nano.scratch[:0], cmdByte, byte(id))
+	var result [1]byte
+	if err := doFixed(nano, cmd, result[:]); err != nil {
+		return 0, err
+	}
+	return result[0], nil
+}
@@ -0,0 +1,133 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+
+package dev
+
+// Round trip times and response deadlines.
+//
+// Until the session is set up, the host allows responseDelay for every
+// response. After that, each response is allowed the time its bytes
+// take on the wire, the time the Nano needs for the command's work, and
+// a margin derived from the round trips measured so far, as TCP derives
+// its retransmission timeout: the smoothed round trip plus four times
+// its mean deviation, but no less than twice the longest recent round
+// trip. The longest decays toward each new sample, so a stall of the
+// USB link or the host's scheduler widens the margin for a while, not
+// for the rest of the session. So a dead link or a lost ack is noticed
+// in milliseconds rather than seconds. The round trip of every fixed
+// command outside the pipeline is a sample; the session setup sends a
+// few syncs to have enough of them before the first vector.
+
+import (
+	"time"
+)
+
+const minResponseDelay = 20 * time.Millisecond // least margin for a response
+const drainQuiet = 100 * time.Millisecond      // quiet time that ends a drain before there are samples
+const rttCalibrations = 8                      // syncs sent to measure round trips
+
+// Bits on the wire per byte: start, 8 data, stop
+const bitsPerByte = 10
+
+// Round trip statistics. A round trip is the time from writing a command
+// to receiving its response, less the time the bytes took on the wire and
+// the Nano's work, so it's mostly the latency of the USB serial link.
+type rttStats struct {
+	samples int
+	srtt    time.Duration // smoothed round trip
+	rttvar  time.Duration // smoothed mean deviation
+	max     time.Duration // longest recent round trip, decaying
+}
+
+func (s *rttStats) add(r time.Duration) {
+	if r < 0 {
+		r = 0
+	}
+	if s.samples == 0 {
+		s.srtt = r
+		s.rttvar = r / 2
+	} else {
+		dev := s.srtt - r
+		if dev < 0 {
+			dev = -dev
+		}
+		s.rttvar = (3*s.rttvar + dev) / 4
+		s.srtt = (7*s.srtt + r) / 8
+	}
+	if r > s.max {
+		s.max = r
+	} else {
+		s.max -= (s.max - r) / 8
+	}
+	s.samples++
+}
+
+// Return the margin to allow for a response, beyond the wire time and
+// the work.
+func (s *rttStats) margin() time.Duration {
+	if s.samples == 0 {
+		return responseDelay
+	}
+	m := s.srtt + 4*s.rttvar
+	if m < 2*s.max {
+		m = 2 * s.max
+	}
+	if m < minResponseDelay {
+		m = minResponseDelay
+	}
+	if m > responseDelay {
+		m = responseDelay
+	}
+	return m
+}
+
+// Return the time n bytes take on the wire, or zero before the baud
+// rate is known.
+func (arduino *Arduino) wireTime(n int) time.Duration {
+	if arduino.caps.Baud == 0 {
+		return 0
+	}
+	return time.Duration(n) * bitsPerByte * time.Second / time.Duration(arduino.caps.Baud)
+}
+
+// Return the deadline for a response, starting now, to commands that
+// put n bytes on the wire, counting both ways, and take the Nano work.
+func (arduino *Arduino) responseDeadline(n int, work time.Duration) deadline {
+	if arduino.fixedTimeout != 0 {
+		return newDeadline(arduino.fixedTimeout + work)
+	}
+	return newDeadline(arduino.rtt.margin() + arduino.wireTime(n) + work)
+}
+
+// Record the round trip of a command that put n bytes on the wire and
+// took the Nano work, written at start and answered just now.
+func (arduino *Arduino) sampleRoundTrip(start time.Time, n int, work time.Duration) {
+	arduino.rtt.add(time.Since(start) - arduino.wireTime(n) - work)
+}
+
+// Return the quiet time on the link that shows the Nano has nothing
+// more to send.
+func (arduino *Arduino) quietTime() time.Duration {
+	if arduino.rtt.samples == 0 {
+		return drainQuiet
+	}
+	return arduino.rtt.margin()
+}
+
+// Use a fixed timeout for every response, or adaptive ones if zero.
+func (arduino *Arduino) SetResponseTimeout(timeout time.Duration) {
+	arduino.fixedTimeout = timeout
+}
+
+// Return the time the Nano may spend on a command before it responds,
+// beyond what fits in the least margin, from its fixed bytes.
+func commandWork(fixed []byte) time.Duration {
+	switch fixed[0] {
+	case CmdJitter:
+		// Four primitives timed units * JitterRepsUnit times each, at
+		// most about 10us apiece with the loop and Timer1 reads.
+		if len(fixed) > 1 {
+			return time.Duration(fixed[1]) * JitterRepsUnit * 4 * 10 * time.Microsecond
+		}
+	}
+	return 0
+}
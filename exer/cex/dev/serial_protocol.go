@@ -3,7 +3,8 @@
 
 package dev
 
-const ProtocolVersion = 13
+const ProtocolVersion = 23
+const ProtocolMinVersion = 13
 
 func Ack(b byte) byte {
 	return ^b
@@ -13,6 +14,18 @@ const CmdBase = 0xE0
 const CmdSync = 0xE1
 const CmdGetVer = 0xE2
 const CmdPoll = 0xE3
+const CmdGetCaps = 0xE4
+const CmdTrace = 0xE5
+const CmdGetTrace = 0xE6
+const CmdCoverage = 0xE7
+const CmdLayout = 0xE8
+const CmdApply = 0xE9
+const CmdClocks = 0xEA
+const CmdTiming = 0xEB
+const CmdJitter = 0xEC
+const CmdLoad = 0xED
+const CmdReplay = 0xEE
+const CmdCheckpoint = 0xEF
 
 const CmdPulse = 0xF0
 const CmdSet = 0xF4
@@ -21,3 +34,92 @@ const CmdGet = 0xF8
 const CmdGetR = 0xF9
 
 const ErrBadcmd = 0x81
+
+const CapPipeline = 0x0001
+const CapTrace = 0x0002
+const CapApply = 0x0004
+const CapEnables = 0x0008
+const CapLogFrames = 0x0010
+const CapCoverage = 0x0020
+const CapClocks = 0x0040
+const CapTiming = 0x0080
+const CapReplay = 0x0100
+const CapCheckpoint = 0x0200
+
+const CapsVersion = 0
+const CapsBits = 1
+const CapsRcvRing = 3
+const CapsRxBuffer = 4
+const CapsMaxCmd = 5
+const CapsMaxPayload = 6
+const CapsBaud = 7
+const CapsSize = 9
+
+const TraceHdrNow = 0
+const TraceHdrDropped = 4
+const TraceHdrSize = 5
+
+const TraceRecCmd = 0
+const TraceRecReceived = 1
+const TraceRecDispatch = 5
+const TraceRecDone = 7
+const TraceRecXmit = 9
+const TraceRecSize = 11
+
+const CoverOnes = 0
+const CoverZeros = 16
+const CoverSize = 32
+const CoverClear = 0x01
+
+const LogFrameSize = 32
+const LogMore = 0x80
+const LogCount = 0x7F
+
+const LayoutWrites = 0
+const LayoutNWrites = 6
+const LayoutClock = 6
+const LayoutCaptures = 7
+const LayoutReads = 10
+const LayoutNReads = 3
+const LayoutSlots = 13
+const LayoutID = 0x0F
+const LayoutReversed = 0x10
+const LayoutEnables = 0x20
+const LayoutNone = 0xFF
+
+const ApplyReads = 0x07
+const ApplyClock = 0x08
+const ApplyPipelined = 0x10
+const ApplyWriteAll = 0x20
+const ApplyNoWrites = 0x40
+const ApplyResults = LayoutNReads
+
+const ClockPhases = 3
+const ClockID = 0x0F
+const ClockReads = 0x70
+const ClockReadsShift = 4
+const ClockResults = ClockPhases * ApplyResults
+
+const TimingAtomic = 0x01
+
+const JitterRepsUnit = 64
+const JitterLeast = 0
+const JitterMost = 2
+const JitterRangeSize = 4
+const JitterEmpty = 0
+const JitterPulse = 4
+const JitterSet = 8
+const JitterRead = 12
+const JitterSize = 16
+
+const TableVectors = 32
+const TableRow = LayoutNWrites + 1
+const TableCtl = 0x40
+const TableRepeat = 0x80
+const TableCopy = 0xC0
+const TableRun = 0x3F
+
+const CheckpointApplied = 0
+const CheckpointValid = 2
+const CheckpointShadow = 3
+const CheckpointSize = CheckpointShadow + LayoutNWrites
@@ -0,0 +1,137 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+
+package dev
+
+// Compressed vector tables.
+//
+// A VectorTable collects up to TableVectors vectors and encodes them as
+// they're added in the compressed stream that CmdLoad sends to the
+// Nano's vector table; see STCMD_LOAD in the firmware's
+// serial_protocol.h. Each vector becomes the cheapest token that gives
+// it: a repeat of the previous vector, merged with the token before if
+// that was a repeat too; a copy of one of the 64 vectors before that;
+// or a delta, a mask of the bytes that changed followed by those bytes.
+// Vectors that differ from the last only in their data inputs cost one
+// byte plus the changed bytes rather than the eight of a CmdApply.
+
+import (
+	"math/bits"
+)
+
+type VectorTable struct {
+	rows    [TableVectors][TableRow]byte
+	n       int
+	prev    [TableRow]byte // the last vector; all zero at first
+	stream  []byte
+	repeat  int // index in stream of the last token, if it's a repeat, else -1
+	results int // results the vectors return
+}
+
+func NewVectorTable() *VectorTable {
+	t := &VectorTable{stream: make([]byte, 0, 4*TableVectors)}
+	t.Reset()
+	return t
+}
+
+// Empty the table, as CmdReplay empties the Nano's.
+func (t *VectorTable) Reset() {
+	t.n = 0
+	t.prev = [TableRow]byte{}
+	t.stream = t.stream[:0]
+	t.repeat = -1
+	t.results = 0
+}
+
+// Return the number of vectors in the table.
+func (t *VectorTable) Len() int {
+	return t.n
+}
+
+// Return true if the table can't take another vector.
+func (t *VectorTable) Full() bool {
+	return t.n == TableVectors
+}
+
+// Return the encoded length of the vectors in the table.
+func (t *VectorTable) StreamLen() int {
+	return len(t.stream)
+}
+
+// Add the vector that Apply(ctl, data) would apply, which must not be
+// pipelined. The table must not be full.
+func (t *VectorTable) Add(ctl byte, data *[LayoutNWrites]byte) {
+	var row [TableRow]byte
+	copy(row[:], data[:])
+	row[LayoutNWrites] = ctl
+	t.results += bits.OnesCount8(ctl & ApplyReads)
+
+	if row == t.prev {
+		if t.repeat >= 0 && t.stream[t.repeat]&TableRun != TableRun {
+			t.stream[t.repeat]++
+		} else {
+			t.repeat = len(t.stream)
+			t.stream = append(t.stream, TableRepeat)
+		}
+	} else if back := t.find(&row); back != 0 {
+		t.repeat = -1
+		t.stream = append(t.stream, TableCopy|byte(back-2))
+	} else {
+		t.repeat = -1
+		var mask byte
+		for i := range row {
+			if row[i] != t.prev[i] {
+				mask |= 1 << i
+			}
+		}
+		t.stream = append(t.stream, mask)
+		for i := range row {
+			if mask&(1<<i) != 0 {
+				t.stream = append(t.stream, row[i])
+			}
+		}
+	}
+	t.rows[t.n] = row
+	t.n++
+	t.prev = row
+}
+
+// Return how far back before the last vector in the table row is,
+// counting the last as 1, if a copy token can reach it, or else 0.
+func (t *VectorTable) find(row *[TableRow]byte) int {
+	for back := 2; back <= TableRun+2 && back <= t.n; back++ {
+		if t.rows[t.n-back] == *row {
+			return back
+		}
+	}
+	return 0
+}
+
+// Return the most stream bytes to send with each CmdLoad through a
+// pipeline with the given window: half of it, less the command, so one
+// load can be on the wire while the Nano decodes the one before.
+func LoadChunk(window int) int {
+	n := window/2 - 2
+	if n < 1 {
+		n = 1
+	}
+	if n > 0xFF {
+		n = 0xFF
+	}
+	return n
+}
+
+// Append the commands that load the table into the Nano and apply it to
+// cb: CmdLoads of at most chunk bytes of the stream each and a
+// CmdReplay. The results of the CmdReplay are those of the vectors'
+// reads, packed one vector after another.
+func (t *VectorTable) Encode(cb *CommandBuffer, chunk int) {
+	for s := t.stream; len(s) > 0; {
+		n := len(s)
+		if n > chunk {
+			n = chunk
+		}
+		cb.Load(s[:n])
+		s = s[n:]
+	}
+	cb.Replay(t.results)
+}
@@ -0,0 +1,71 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+
+package dev
+
+// Bus timing.
+//
+// Since protocol v21, the Nano can run each set, pulse, and read of a
+// register with interrupts masked, so that an ISR can't stretch the
+// decoder pulses or the read window, and can time those primitives
+// with its Timer1 to show how much they vary in either mode.
+
+import (
+	"encoding/binary"
+	"fmt"
+)
+
+// The least and most CPU cycles a bus primitive took. At 16MHz a cycle
+// is 62.5ns.
+type JitterRange struct {
+	Least int
+	Most  int
+}
+
+// The timing of each bus primitive. Empty is the cost of timing nothing,
+// which the others include.
+type Jitter struct {
+	Empty JitterRange
+	Pulse JitterRange
+	Set   JitterRange
+	Read  JitterRange
+}
+
+// Turn atomic bus transactions on or off. Pipelines must be flushed.
+func SetAtomicBus(nano *Arduino, on bool) error {
+	if !nano.caps.Has(CapTiming) {
+		return fmt.Errorf("the Arduino firmware doesn't support timing modes")
+	}
+	var arg byte
+	if on {
+		arg = TimingAtomic
+	}
+	_, err := DoFixedCommand(nano, []byte{CmdTiming, arg}, 0)
+	return err
+}
+
+// Time each bus primitive about reps times in the current timing mode.
+// The count is rounded up to a multiple of JitterRepsUnit. Pipelines
+// must be flushed.
+func MeasureJitter(nano *Arduino, reps int) (*Jitter, error) {
+	if !nano.caps.Has(CapTiming) {
+		return nil, fmt.Errorf("the Arduino firmware doesn't support timing modes")
+	}
+	units := (reps + JitterRepsUnit - 1) / JitterRepsUnit
+	if units < 1 || units > 255 {
+		return nil, fmt.Errorf("jitter repetitions %d out of range", reps)
+	}
+	b, err := DoCountedReceive(nano, []byte{CmdJitter, byte(units)})
+	if err != nil {
+		return nil, err
+	}
+	if len(b) != JitterSize {
+		return nil, fmt.Errorf("bad jitter response length %d", len(b))
+	}
+	rng := func(off int) JitterRange {
+		return JitterRange{
+			int(binary.LittleEndian.Uint16(b[off+JitterLeast:])),
+			int(binary.LittleEndian.Uint16(b[off+JitterMost:])),
+		}
+	}
+	return &Jitter{rng(JitterEmpty), rng(JitterPulse), rng(JitterSet), rng(JitterRead)}, nil
+}
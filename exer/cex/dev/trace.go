@@ -0,0 +1,263 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+
+package dev
+
+// Command timeline tracing.
+//
+// A Trace collects spans of time, on the host and on the Nano, and writes
+// them as a Chrome trace file, which can be viewed in chrome://tracing or
+// Perfetto. The host records spans directly. The Nano, in trace mode (see
+// CmdTrace), records the receive, dispatch, completion, and transmit time
+// of each command in micros(). Those records are fetched with CmdGetTrace
+// and placed on the host's timeline using the offset between the clocks.
+//
+// Each fetch also samples the Nano's clock. The Nano's time is assumed to
+// be the host's at the midpoint of the round trip, so the uncertainty of
+// a sample is half the round trip. The sample with the least uncertainty
+// gives the offset used for the Nano's records when the file is
+// written. The Nano's clock starts again when it resets, so a trace that
+// carries on across a reconnect keeps a clock and an offset for each
+// session with the Nano (see Arduino.SetTrace), and places each record
+// with its own session's.
+//
+// A nil *Trace is valid and records nothing, so callers need not check
+// whether tracing is enabled.
+
+import (
+	"bufio"
+	"encoding/binary"
+	"encoding/json"
+	"fmt"
+	"os"
+	"sync"
+	"time"
+)
+
+// Timeline lanes, which show as threads in the viewer
+const (
+	TraceLoader  = 1
+	TraceEncoder = 2
+	TraceLink    = 3
+	TraceNano    = 4
+)
+
+var traceLaneNames = map[int]string{
+	TraceLoader:  "loader",
+	TraceEncoder: "encoder",
+	TraceLink:    "link",
+	TraceNano:    "Nano",
+}
+
+var commandNames = map[byte]string{
+	CmdSync:       "sync",
+	CmdGetVer:     "getver",
+	CmdPoll:       "poll",
+	CmdGetCaps:    "getcaps",
+	CmdTrace:      "trace",
+	CmdGetTrace:   "gettrace",
+	CmdCoverage:   "coverage",
+	CmdLayout:     "layout",
+	CmdApply:      "apply",
+	CmdClocks:     "clocks",
+	CmdTiming:     "timing",
+	CmdJitter:     "jitter",
+	CmdLoad:       "load",
+	CmdReplay:     "replay",
+	CmdCheckpoint: "checkpoint",
+	CmdPulse:      "pulse",
+	CmdSet:        "set",
+	CmdSetR:       "setr",
+	CmdGet:        "get",
+	CmdGetR:       "getr",
+}
+
+func commandName(cmd byte) string {
+	if name, ok := commandNames[cmd]; ok {
+		return name
+	}
+	return fmt.Sprintf("0x%02X", cmd)
+}
+
+type traceSpan struct {
+	lane   int
+	name   string
+	detail string
+	start  int64 // microseconds; host time, or Nano time for TraceNano
+	dur    int64
+	clock  int // for TraceNano, the index of the session's clock
+}
+
+// The Nano's clock in one session: unwrapped micros() and the best
+// offset to host time
+type nanoClock struct {
+	last        uint32
+	epoch       int64
+	sampled     bool
+	offset      int64
+	uncertainty int64
+}
+
+type Trace struct {
+	mu      sync.Mutex
+	start   time.Time
+	spans   []traceSpan
+	clocks  []nanoClock // one for each session, the current one last
+	dropped int
+}
+
+func NewTrace() *Trace {
+	return &Trace{start: time.Now(), spans: make([]traceSpan, 0, 4096)}
+}
+
+// Start the clock of a new session with the Nano, whose micros() has
+// started again from zero.
+func (t *Trace) newSession() {
+	if t == nil {
+		return
+	}
+	t.mu.Lock()
+	t.clocks = append(t.clocks, nanoClock{})
+	t.mu.Unlock()
+}
+
+func (t *Trace) since(when time.Time) int64 {
+	return when.Sub(t.start).Microseconds()
+}
+
+// Record a span on the given lane from start until now. The detail,
+// if not empty, is shown with the span in the viewer.
+func (t *Trace) Span(lane int, name string, detail string, start time.Time) {
+	if t == nil {
+		return
+	}
+	end := time.Now()
+	t.mu.Lock()
+	t.spans = append(t.spans, traceSpan{lane, name, detail, t.since(start), end.Sub(start).Microseconds(), 0})
+	t.mu.Unlock()
+}
+
+// Turn the Nano's trace mode on or off. Trace mode must be on for
+// FetchTrace() to return anything. On success, return the number of
+// command records the Nano can hold between fetches.
+func EnableTrace(nano *Arduino, on bool) (int, error) {
+	if !nano.caps.Has(CapTrace) {
+		return 0, fmt.Errorf("the Arduino firmware doesn't support tracing")
+	}
+	var arg byte
+	if on {
+		arg = 1
+	}
+	b, err := DoFixedCommand(nano, []byte{CmdTrace, arg}, 1)
+	if err != nil {
+		return 0, err
+	}
+	return int(b[0]), nil
+}
+
+// Fetch the Nano's trace records into t. Pipelines must be flushed.
+func FetchTrace(nano *Arduino, t *Trace) error {
+	if t == nil {
+		return nil
+	}
+	sent := time.Now()
+	b, err := DoCountedReceive(nano, []byte{CmdGetTrace})
+	if err != nil {
+		return err
+	}
+	received := time.Now()
+	if len(b) < TraceHdrSize || (len(b)-TraceHdrSize)%TraceRecSize != 0 {
+		return fmt.Errorf("bad trace response length %d", len(b))
+	}
+
+	t.mu.Lock()
+	defer t.mu.Unlock()
+	if len(t.clocks) == 0 {
+		t.clocks = append(t.clocks, nanoClock{})
+	}
+	session := len(t.clocks) - 1
+	c := &t.clocks[session]
+
+	// Unwrap the Nano's clock, which wraps about every 70 minutes
+	// (so we assume fetches are more frequent than that).
+	now := binary.LittleEndian.Uint32(b[TraceHdrNow:])
+	if c.sampled && now < c.last {
+		c.epoch += 1 << 32
+	}
+	c.last = now
+	nanoNow := c.epoch + int64(now)
+
+	rtt := received.Sub(sent).Microseconds()
+	if !c.sampled || rtt/2 < c.uncertainty {
+		c.offset = t.since(sent) + rtt/2 - nanoNow
+		c.uncertainty = rtt / 2
+	}
+	c.sampled = true
+	t.dropped += int(b[TraceHdrDropped])
+
+	for rec := b[TraceHdrSize:]; len(rec) > 0; rec = rec[TraceRecSize:] {
+		cmd := rec[TraceRecCmd]
+		received := nanoNow - int64(now-binary.LittleEndian.Uint32(rec[TraceRecReceived:]))
+		dispatched := int64(binary.LittleEndian.Uint16(rec[TraceRecDispatch:]))
+		done := int64(binary.LittleEndian.Uint16(rec[TraceRecDone:]))
+		xmit := int64(binary.LittleEndian.Uint16(rec[TraceRecXmit:]))
+		name := commandName(cmd)
+
+		t.spans = append(t.spans, traceSpan{TraceNano, "receive", name, received, dispatched, session})
+		t.spans = append(t.spans, traceSpan{TraceNano, name, "", received + dispatched, done - dispatched, session})
+		if xmit != 0xFFFF {
+			t.spans = append(t.spans, traceSpan{TraceNano, "transmit", name, received + done, xmit - done, session})
+		}
+	}
+	return nil
+}
+
+// Write the trace in the Chrome trace event format.
+func (t *Trace) WriteFile(path string) error {
+	f, err := os.Create(path)
+	if err != nil {
+		return err
+	}
+	w := bufio.NewWriter(f)
+
+	t.mu.Lock()
+	var uncertainty int64 // the worst of the sessions'
+	for _, c := range t.clocks {
+		if c.uncertainty > uncertainty {
+			uncertainty = c.uncertainty
+		}
+	}
+	fmt.Fprintf(w, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"nanoClockUncertaintyUs\":%d,\"nanoRecordsDropped\":%d},\n",
+		uncertainty, t.dropped)
+	fmt.Fprintf(w, "\"traceEvents\":[")
+	sep := "\n"
+	for lane := TraceLoader; lane <= TraceNano; lane++ {
+		fmt.Fprintf(w, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":%s}}",
+			sep, lane, jsonString(traceLaneNames[lane]))
+		sep = ",\n"
+	}
+	for _, s := range t.spans {
+		start := s.start
+		if s.lane == TraceNano {
+			start += t.clocks[s.clock].offset
+		}
+		fmt.Fprintf(w, "%s{\"name\":%s,\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%d,\"dur\":%d",
+			sep, jsonString(s.name), s.lane, start, s.dur)
+		if s.detail != "" {
+			fmt.Fprintf(w, ",\"args\":{\"detail\":%s}", jsonString(s.detail))
+		}
+		fmt.Fprintf(w, "}")
+	}
+	fmt.Fprintf(w, "\n]}\n")
+	t.mu.Unlock()
+
+	if err := w.Flush(); err != nil {
+		f.Close()
+		return err
+	}
+	return f.Close()
+}
+
+func jsonString(s string) string {
+	b, _ := json.Marshal(s)
+	return string(b)
+}
@@ -0,0 +1,140 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+
+package main
+
+// Differential testing against a golden device.
+//
+// With -golden, a second exerciser holds a known good chip. The link
+// sends each item's commands to both, through a pipeline for each, and
+// passes the item on when the results of both have arrived. Rather than
+// checking the results against the vector's H and L values, the checker
+// compares the candidate's outputs with the golden device's, so every
+// output pin is captured and read whether the vector file checks it or
+// not, and the vector file needn't know the right answers at all.
+//
+// With -lfsr n, each PLCC vector (other than one with clock phases) is
+// also applied n more times with its A and B inputs taken from a
+// pseudorandom sequence. The control inputs are the vector's, so a file
+// of a few vectors that set up each ALU function drives thousands of
+// operands through them. The sequence is generated on the host from
+// -seed and shipped to both devices as ordinary vectors, so the stimulus
+// is identical on both links and a difference can be reproduced by
+// running again. ZIF vectors get no variants: the inputs of a PAL or
+// GAL may turn its I/O pins around, so random ones could make the
+// device drive pins the exerciser is driving.
+
+import (
+	"fmt"
+	"log"
+)
+
+// The results of an item's commands from the golden device. Delivery
+// mirrors that of the candidate's, including pipelining.
+type goldenResults struct {
+	it      *vectorItem
+	results [itemResults]byte
+	done    bool
+	err     error
+}
+
+// Receive the results of the item's commands from the golden device's
+// pipeline. This implements dev.Completion.
+func (g *goldenResults) Complete(results []byte, err error) {
+	deliverResults(g.it, func(v *vectorItem) resultSink { return &v.golden }, results, err)
+}
+
+func (g *goldenResults) complete(results []byte, err error) {
+	copy(g.results[:], results)
+	g.err = err
+	g.done = true
+}
+
+// Return the mask of every output pin of the device under test in r,
+// which is what a differential test compares. For the PLCC, that's F
+// and the five flags. For the ZIF, it's the pins of each group that the
+// exerciser doesn't drive, except pin 1, TSTCLK.
+func outputMask(socket byte, r *vectorRecord) [3]byte {
+	if socket == socketPLCC {
+		return [3]byte{0xFF, 0xFF, 0x1F}
+	}
+	var mask [3]byte
+	for i, g := range zifGroups {
+		if r.drive[zifU10]&g.enable == 0 {
+			continue
+		}
+		for pin := g.first; pin <= g.last; pin++ {
+			mask[i] |= 1 << ((pin - 1) % 8)
+		}
+	}
+	return mask
+}
+
+// A 32-bit Galois LFSR with the maximal length taps x^32 + x^22 + x^2
+// + x + 1. It must not be seeded with zero.
+type lfsr uint32
+
+func (l *lfsr) next() byte {
+	for i := 0; i < 8; i++ {
+		if *l&1 != 0 {
+			*l = *l>>1 ^ 0x80200003
+		} else {
+			*l >>= 1
+		}
+	}
+	return byte(*l)
+}
+
+// Replace the A and B inputs of the PLCC vector r with bytes from l.
+func randomizeInputs(r *vectorRecord, l *lfsr) {
+	for _, i := range [...]int{plccU4, plccU5, plccU1, plccU2} {
+		r.drive[i] = l.next()
+	}
+}
+
+// Describe where a vector came from for the log: its line and, if it
+// has random inputs, the variant and the inputs.
+func vectorSource(it *vectorItem, line int) string {
+	if it.variant == 0 {
+		return fmt.Sprintf("line %d", line)
+	}
+	d := &it.drive
+	return fmt.Sprintf("line %d variant %d (A %%%02X%02X B %%%02X%02X)", line, it.variant,
+		d[plccU5], d[plccU4], d[plccU2], d[plccU1])
+}
+
+// Compare the outputs of a vector on the candidate with those on the
+// golden device. Log and return the number of differences, counted as
+// checkPLCC and checkZIF count failures.
+func diffResults(it *vectorItem, line int, check *vectorCheck, results []byte, golden []byte) int {
+	got := captures(check.reads, results)
+	want := captures(check.reads, golden)
+	where := vectorSource(it, line)
+
+	differences := 0
+	if it.socket == socketPLCC {
+		f := int(got[0])<<8 | int(got[1])
+		gf := int(want[0])<<8 | int(want[1])
+		if f != gf {
+			log.Printf("  %s: differ F 0x%04X, golden 0x%04X", where, f, gf)
+			differences++
+		}
+		names := "CPGZV"
+		for i := 0; i < len(names); i++ {
+			if (got[2]^want[2])&check.mask[2]&(1<<i) != 0 {
+				log.Printf("    %s: differ pin '%c' %d, golden %d", where, names[i], (got[2]>>i)&1, (want[2]>>i)&1)
+				differences++
+			}
+		}
+		return differences
+	}
+	for i := range got {
+		bad := (got[i] ^ want[i]) & check.mask[i]
+		for j := 0; j < 8; j++ {
+			if bad&(1<<j) != 0 {
+				log.Printf("  %s: differ pin %d %d, golden %d", where, 8*i+j+1, (got[i]>>j)&1, (want[i]>>j)&1)
+				differences++
+			}
+		}
+	}
+	return differences
+}
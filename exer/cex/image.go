@@ -0,0 +1,390 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+
+package main
+
+// Precompiled vector images.
+//
+// Tokenizing and parsing a vector file costs far more host time than
+// sending the resulting vectors, and a regression suite parses the same
+// files on every run. So each vector file is compiled once into a packed
+// binary image: one fixed-size record per vector holding the latch bytes
+// in the order they are written to the exerciser, the clock flag and
+// count, and the expected values and masks of the outputs. Each clock
+// phase ('+' line) of a vector is a record like a vector's that follows
+// it. Log comments ('>' lines) are kept in order as records that refer
+// to a string table.
+//
+// The image is cached next to the vector file (t.tv -> t.tvi) and is keyed
+// by a SHA-256 hash of the vector file's content, so editing the vector
+// file invalidates it. Later runs map the cached image into memory and
+// apply the vectors without parsing anything. If the cache can't be
+// written, the image is compiled into memory on every run.
+//
+// All multibyte values are little endian.
+//
+// Header (64 bytes):
+//   0..3    magic "CEXV"
+//   4       format version
+//   5       socket (0 = PLCC, 1 = ZIF)
+//   8..11   number of records
+//   12..15  offset of the string table
+//   16..19  length of the string table
+//   32..63  SHA-256 of the vector file
+//
+// Record (20 bytes):
+//   0..3    line number in the vector file
+//   4       kind (vector, clock phase, or comment)
+//   5       flags (clocked)
+//   6..11   drive bytes (vector) or string offset and length (comment)
+//   12..14  expected output bits
+//   15..17  output mask; 1 bits are checked, 0 bits are X or inputs
+//   18      number of clock pulses
+//
+// For PLCC vectors the drive bytes are the values of output registers
+// U4, U5, U8, U10, U1, and U2 and the expected bytes are F<15:8>, F<7:0>,
+// and the flags C, P, G, Z, V at bits 0..4. For ZIF vectors the drive
+// bytes are U1, U2, U8, and U10, whose output enables give the direction
+// of the pins, and the expected bytes are pins 1..8, 9..16, and 17..24.
+
+import (
+	"bufio"
+	"bytes"
+	"crypto/sha256"
+	"encoding/binary"
+	"fmt"
+	"log"
+	"os"
+	"path/filepath"
+	"strings"
+	"syscall"
+
+	"cex/dev"
+	"cex/utils"
+)
+
+const imageSuffix = ".tvi"
+const imageMagic = "CEXV"
+const imageVersion = 3
+const imageHeaderSize = 64
+const imageRecordSize = 20
+
+// Header field offsets
+const (
+	hdrMagic      = 0
+	hdrVersion    = 4
+	hdrSocket     = 5
+	hdrRecords    = 8
+	hdrStringsOff = 12
+	hdrStringsLen = 16
+	hdrHash       = 32
+)
+
+// Record field offsets
+const (
+	recLine   = 0
+	recKind   = 4
+	recFlags  = 5
+	recDrive  = 6
+	recExpect = 12
+	recMask   = 15
+	recClocks = 18
+)
+
+// Record kinds
+const (
+	recordVector  = 1
+	recordComment = 2
+	recordPhase   = 3 // a clock phase of the vector before it
+)
+
+// Record flags
+const (
+	flagClocked = 0x01
+)
+
+// Sockets
+const (
+	socketPLCC = 0
+	socketZIF  = 1
+)
+
+var socketNames = []string{"PLCC", "ZIF"}
+
+// One decoded image record. Decoding copies the record
+// out of the image, so it does not allocate.
+type vectorRecord struct {
+	line   int
+	kind   byte
+	flags  byte
+	drive  [6]byte
+	expect [3]byte
+	mask   [3]byte
+	clocks byte
+}
+
+func (r *vectorRecord) clocked() bool {
+	return r.flags&flagClocked != 0
+}
+
+// A compiled vector file, either mapped from the cache or in memory.
+type vectorImage struct {
+	data    []byte // the entire image
+	socket  byte
+	records int
+	strings []byte
+	mapped  bool
+}
+
+// Return the image for the vector file at path, from the cache if it is
+// current, else by compiling the file (and trying to cache the result).
+func loadImage(path string) (*vectorImage, error) {
+	src, err := os.ReadFile(path)
+	if err != nil {
+		return nil, err
+	}
+	hash := sha256.Sum256(src)
+	cachePath := imagePath(path)
+
+	if img, err := mapImage(cachePath, hash); err == nil {
+		if debug {
+			log.Printf("using cached image %s", cachePath)
+		}
+		return img, nil
+	}
+
+	data, err := compileImage(src, hash)
+	if err != nil {
+		return nil, fmt.Errorf("%s: %v", path, err)
+	}
+	if err := writeImage(cachePath, data); err != nil {
+		log.Printf("not caching compiled vectors: %v", err)
+	}
+	return newImage(data, false)
+}
+
+func imagePath(path string) string {
+	return strings.TrimSuffix(path, filepath.Ext(path)) + imageSuffix
+}
+
+// Map the cached image at path into memory if it exists, is well formed,
+// and was compiled from a vector file with the given hash.
+func mapImage(path string, hash [sha256.Size]byte) (*vectorImage, error) {
+	f, err := os.Open(path)
+	if err != nil {
+		return nil, err
+	}
+	defer f.Close()
+	fi, err := f.Stat()
+	if err != nil {
+		return nil, err
+	}
+	if fi.Size() < imageHeaderSize {
+		return nil, fmt.Errorf("%s: too short", path)
+	}
+	data, err := syscall.Mmap(int(f.Fd()), 0, int(fi.Size()), syscall.PROT_READ, syscall.MAP_SHARED)
+	if err != nil {
+		return nil, err
+	}
+	if !bytes.Equal(data[hdrHash:hdrHash+sha256.Size], hash[:]) {
+		syscall.Munmap(data)
+		return nil, fmt.Errorf("%s: stale", path)
+	}
+	img, err := newImage(data, true)
+	if err != nil {
+		syscall.Munmap(data)
+		return nil, err
+	}
+	return img, nil
+}
+
+// Validate the header of the image in data and return the image.
+func newImage(data []byte, mapped bool) (*vectorImage, error) {
+	if len(data) < imageHeaderSize || string(data[hdrMagic:hdrMagic+4]) != imageMagic {
+		return nil, fmt.Errorf("not a vector image")
+	}
+	if data[hdrVersion] != imageVersion {
+		return nil, fmt.Errorf("vector image version %d, expected %d", data[hdrVersion], imageVersion)
+	}
+	img := &vectorImage{data: data, socket: data[hdrSocket], mapped: mapped}
+	img.records = int(binary.LittleEndian.Uint32(data[hdrRecords:]))
+	stringsOff := int(binary.LittleEndian.Uint32(data[hdrStringsOff:]))
+	stringsLen := int(binary.LittleEndian.Uint32(data[hdrStringsLen:]))
+	if int(img.socket) >= len(socketNames) ||
+		imageHeaderSize+img.records*imageRecordSize > stringsOff ||
+		stringsOff+stringsLen > len(data) {
+		return nil, fmt.Errorf("corrupt vector image")
+	}
+	img.strings = data[stringsOff : stringsOff+stringsLen]
+	return img, nil
+}
+
+// Write the image atomically so that a concurrent or interrupted
+// run never sees a partial file.
+func writeImage(path string, data []byte) error {
+	tmp := fmt.Sprintf("%s.%d", path, os.Getpid())
+	if err := os.WriteFile(tmp, data, 0644); err != nil {
+		return err
+	}
+	if err := os.Rename(tmp, path); err != nil {
+		os.Remove(tmp)
+		return err
+	}
+	return nil
+}
+
+func (img *vectorImage) Close() error {
+	if img.mapped {
+		img.mapped = false
+		return syscall.Munmap(img.data)
+	}
+	return nil
+}
+
+func (img *vectorImage) Socket() string {
+	return socketNames[img.socket]
+}
+
+func (img *vectorImage) Len() int {
+	return img.records
+}
+
+// Decode record i into r.
+func (img *vectorImage) Record(i int, r *vectorRecord) {
+	b := img.data[imageHeaderSize+i*imageRecordSize:]
+	r.line = int(binary.LittleEndian.Uint32(b[recLine:]))
+	r.kind = b[recKind]
+	r.flags = b[recFlags]
+	copy(r.drive[:], b[recDrive:recDrive+6])
+	copy(r.expect[:], b[recExpect:recExpect+3])
+	copy(r.mask[:], b[recMask:recMask+3])
+	r.clocks = b[recClocks]
+}
+
+// Return the text of a comment record.
+func (img *vectorImage) Comment(r *vectorRecord) string {
+	off := binary.LittleEndian.Uint32(r.drive[0:])
+	n := binary.LittleEndian.Uint16(r.drive[4:])
+	return string(img.strings[off : off+uint32(n)])
+}
+
+// Compile the content of a vector file into an image. The file format
+// is described in the README in this directory.
+func compileImage(src []byte, hash [sha256.Size]byte) ([]byte, error) {
+	var tf *utils.TestFile
+	var socket byte
+	var records []byte
+	var strs []byte
+	var rec [imageRecordSize]byte
+	var lastDrive [6]byte // drive bytes of the last vector
+	phases := 0           // clock phases of the last vector, 0 if none may follow
+	n := 0
+
+	scanner := bufio.NewScanner(bytes.NewReader(src))
+	for lineNumber := 1; scanner.Scan(); lineNumber++ {
+		// First check for empty lines and comments. Lines must
+		// be left-justified. Lines starting with spaces are empty.
+		line := scanner.Text()
+		if len(line) == 0 || line[0] == '#' || line[0] == SPACE {
+			continue
+		}
+
+		for i := range rec {
+			rec[i] = 0
+		}
+		binary.LittleEndian.PutUint32(rec[recLine:], uint32(lineNumber))
+
+		// Log comment, output when the image is applied
+		if line[0] == '>' {
+			phases = 0
+			rec[recKind] = recordComment
+			binary.LittleEndian.PutUint32(rec[recDrive:], uint32(len(strs)))
+			binary.LittleEndian.PutUint16(rec[recDrive+4:], uint16(len(line)-1))
+			strs = append(strs, line[1:]...)
+			records = append(records, rec[:]...)
+			n++
+			continue
+		}
+
+		tokens := strings.Split(line, string(SPACE))
+
+		// Handle the exactly-once-per-file "socket" statement
+		if tokens[0] == "socket" {
+			if tf != nil || len(tokens) != 2 {
+				return nil, fmt.Errorf("line %d: bad 'socket' statement", lineNumber)
+			}
+			tf = utils.NewTestFile(tokens[1], nil)
+			if tf == nil {
+				return nil, fmt.Errorf("line %d: bad socket type", lineNumber)
+			}
+			if tf.Socket() == "ZIF" {
+				socket = socketZIF
+			}
+			continue
+		}
+
+		// Must be a vector, a clock phase, or error.
+		if tf == nil {
+			return nil, fmt.Errorf("line %d: vector before 'socket' statement", lineNumber)
+		}
+		kind := byte(recordVector)
+		if tokens[0] == "+" {
+			if phases == 0 {
+				return nil, fmt.Errorf("line %d: clock phase doesn't follow a vector", lineNumber)
+			}
+			if phases == dev.ClockPhases {
+				return nil, fmt.Errorf("line %d: more than %d clock phases", lineNumber, dev.ClockPhases)
+			}
+			kind = recordPhase
+			tokens = tokens[1:]
+		}
+		tf.Clear()
+		if err := parseVector(tf, tokens); err != nil {
+			return nil, fmt.Errorf("line %d: %v", lineNumber, err)
+		}
+		if debug {
+			log.Printf("Parsed: %s\n", tf)
+		}
+
+		var v vectorRecord
+		if socket == socketPLCC {
+			compilePLCC(tf, &v)
+		} else if err := compileZIF(tf, &v); err != nil {
+			return nil, fmt.Errorf("line %d: %v", lineNumber, err)
+		}
+		if kind == recordPhase {
+			if v.drive != lastDrive {
+				return nil, fmt.Errorf("line %d: clock phase has different inputs than its vector", lineNumber)
+			}
+			phases++
+		} else {
+			lastDrive = v.drive
+			phases = 1
+		}
+		rec[recKind] = kind
+		rec[recFlags] = v.flags
+		copy(rec[recDrive:], v.drive[:])
+		copy(rec[recExpect:], v.expect[:])
+		copy(rec[recMask:], v.mask[:])
+		rec[recClocks] = v.clocks
+		records = append(records, rec[:]...)
+		n++
+	}
+	if err := scanner.Err(); err != nil {
+		return nil, err
+	}
+	if tf == nil {
+		return nil, fmt.Errorf("no 'socket' statement")
+	}
+
+	stringsOff := imageHeaderSize + len(records)
+	data := make([]byte, stringsOff, stringsOff+len(strs))
+	copy(data[hdrMagic:], imageMagic)
+	data[hdrVersion] = imageVersion
+	data[hdrSocket] = socket
+	binary.LittleEndian.PutUint32(data[hdrRecords:], uint32(n))
+	binary.LittleEndian.PutUint32(data[hdrStringsOff:], uint32(stringsOff))
+	binary.LittleEndian.PutUint32(data[hdrStringsLen:], uint32(len(strs)))
+	copy(data[hdrHash:], hash[:])
+	copy(data[imageHeaderSize:], records)
+	return append(data, strs...), nil
+}
@@ -10,11 +10,27 @@ import (
 	"io"
 	"log"
 	"os"
+	"time"
 
 	"cex/dev"
 )
 
 var debug = false
+var optimize = true
+var reorder = false
+var pipelined = false
+var replay = false
+var coverage = false
+var lowLatency = true
+var atomicBus = false
+var jitter = false
+var traceFile = ""
+var responseTimeout time.Duration
+var port = arduinoNanoDevice
+var goldenPort = ""
+var lfsrVariants = 0
+var lfsrSeed uint = 1
+var reconnects = 0
 var nanoLog *log.Logger
 
 // When the Arduino (the "Nano") is connected by USB-serial, opening the port
@@ -23,6 +39,10 @@ var nanoLog *log.Logger
 const arduinoNanoDevice = "/dev/cu.usbserial-AQ0169PT"
 const baudRate = 115200 // Note: change requires updating the Arduino firmware
 
+// How long to wait before trying again to reconnect to a Nano that
+// couldn't be reopened.
+const reconnectDelay = 2 * time.Second
+
 func main() {
 	os.Exit(submain())
 }
@@ -34,8 +54,31 @@ func submain() int { // return exit code
 	log.Println("firing up")
 
 	flag.BoolVar(&debug, "d", false, "enable debug output")
+	flag.BoolVar(&optimize, "O", true, "skip unchanged register writes and unchecked reads")
+	flag.BoolVar(&reorder, "reorder", false, "reorder unclocked vectors to reduce register writes")
+	flag.BoolVar(&pipelined, "pipelined", false, "return each vector's results with the next vector's command")
+	flag.BoolVar(&replay, "replay", false, "send vectors in compressed tables that the Nano replays")
+	flag.BoolVar(&coverage, "coverage", false, "report the pins the vectors didn't drive or see both ways")
+	flag.BoolVar(&atomicBus, "atomic", false, "mask interrupts on the Nano during each register access")
+	flag.BoolVar(&jitter, "jitter", false, "measure the timing of the Nano's register accesses")
+	flag.StringVar(&traceFile, "trace", "", "write a Chrome trace of vector processing to `file`")
+	flag.BoolVar(&lowLatency, "lowlatency", true, "put the serial port in low latency mode")
+	flag.DurationVar(&responseTimeout, "timeout", 0, "fixed response timeout (default: adapt to measured round trips)")
+	flag.StringVar(&port, "port", arduinoNanoDevice, "serial `device` of the Nano (or the simulator)")
+	flag.StringVar(&goldenPort, "golden", "", "serial `device` of a second Nano holding a known good chip to compare with")
+	flag.IntVar(&lfsrVariants, "lfsr", 0, "with -golden, apply each vector `n` more times with random data inputs")
+	flag.UintVar(&lfsrSeed, "seed", 1, "seed of the random data inputs of -lfsr")
+	flag.IntVar(&reconnects, "reconnect", 0, "if the link fails, reconnect and resume the vector files from the last checkpoint, up to `n` times")
 	flag.Parse()
 	vectorFiles := flag.Args()
+	if lfsrVariants != 0 && goldenPort == "" {
+		log.Printf("-lfsr requires -golden")
+		return 2
+	}
+	if uint32(lfsrSeed) == 0 {
+		log.Printf("-seed must not be zero")
+		return 2
+	}
 
 	// Open the Nano's log file (not the Nano itself)
 	nanoLogFile, err := os.OpenFile("Nano.log", os.O_APPEND|os.O_CREATE|os.O_WRONLY, 0644)
@@ -46,32 +89,126 @@ func submain() int { // return exit code
 	defer nanoLogFile.Close()
 	nanoLog = log.New(nanoLogFile, "", log.Lmsgprefix|log.Lmicroseconds)
 
-	// Now open the Nano (serial device)
-	nano, err := dev.NewArduino(arduinoNanoDevice, baudRate, nanoLog, debug)
+	// Now open the Nano (serial device) and create a protocol
+	// connection to it. A run that resumes after the link fails
+	// replaces it, and the golden Nano too.
+	nano, err := openNano("Arduino device", port)
 	if err != nil {
-		log.Printf("opening Arduino device %s: %v", arduinoNanoDevice, err)
+		log.Printf("%v", err)
 		return 2
 	}
-	defer nano.Close()
+	defer func() {
+		if nano != nil {
+			nano.Close()
+		}
+	}()
 
-	// Create a protocol connection to the Nano
-	if err := dev.CreateSession(nano); err != nil {
-		log.Printf("creating session with Arduino device %s: %v", arduinoNanoDevice, err)
-		return 2
+	// And to the golden Nano, if any. It shares the Nano log.
+	var golden *dev.Arduino
+	if goldenPort != "" && len(vectorFiles) > 0 {
+		if golden, err = openNano("golden Arduino device", goldenPort); err != nil {
+			log.Printf("%v", err)
+			return 2
+		}
+		defer func() {
+			if golden != nil {
+				golden.Close()
+			}
+		}()
+		if lfsrVariants != 0 {
+			log.Printf("comparing with %s, %d random variant(s) of each vector from seed %d", goldenPort, lfsrVariants, lfsrSeed)
+		} else {
+			log.Printf("comparing with %s", goldenPort)
+		}
+	}
+
+	if jitter {
+		if err := reportJitter(nano); err != nil {
+			log.Printf("measuring jitter: %v", err)
+			return 2
+		}
+		if len(vectorFiles) == 0 {
+			return 0
+		}
 	}
 
 	// If there are vector files, process them and done
 	if len(vectorFiles) > 0 {
-		totalFailures := 0
-		for _, vf := range vectorFiles {
-			log.Printf("processing vector file %s", vf)
-			failureCount, err := DoVectorFile(vf, nano)
-			if err != nil {
-				log.Printf("vector file %s: error: %s\n", vf, err)
-				return 2
+		setAtomicBus := func() error {
+			if !atomicBus {
+				return nil
+			}
+			if err := dev.SetAtomicBus(nano, true); err != nil {
+				return err
 			}
-			log.Printf("vector file %s: %d failure(s)", vf, failureCount)
-			totalFailures += failureCount
+			if golden != nil {
+				if err := dev.SetAtomicBus(golden, true); err != nil {
+					return fmt.Errorf("golden device: %v", err)
+				}
+			}
+			return nil
+		}
+		if err := setAtomicBus(); err != nil {
+			log.Printf("error: %v", err)
+			return 2
+		}
+		var trace *dev.Trace
+		if traceFile != "" {
+			trace = dev.NewTrace()
+			nano.SetTrace(trace)
+		}
+
+		// Close and reopen the Nanos, which resets them, so the run
+		// can resume. The trace carries on.
+		reopen := func() error {
+			if nano != nil {
+				nano.Close()
+			}
+			if golden != nil {
+				golden.Close()
+			}
+			nano, golden = nil, nil
+			var err error
+			if nano, err = openNano("Arduino device", port); err != nil {
+				return err
+			}
+			nano.SetTrace(trace)
+			if goldenPort != "" {
+				if golden, err = openNano("golden Arduino device", goldenPort); err != nil {
+					return err
+				}
+			}
+			return setAtomicBus()
+		}
+
+		progress := &checkpoint{}
+		totalFailures, err := DoVectorFiles(vectorFiles, nano, golden, progress)
+		for tries := 0; tries < reconnects && isLinkError(err); tries++ {
+			if progress.clocked != 0 {
+				log.Printf("not resuming: line %d of vector file %s clocked the device after the last checkpoint and may have been applied",
+					progress.clocked, vectorFiles[progress.file])
+				break
+			}
+			log.Printf("error: %s", err)
+			log.Printf("reconnecting to resume %s", progress.describe(vectorFiles))
+			if err = reopen(); err != nil {
+				// The device may not be back yet, e.g. on USB.
+				err = linkError{err}
+				time.Sleep(reconnectDelay)
+				continue
+			}
+			totalFailures, err = DoVectorFiles(vectorFiles, nano, golden, progress)
+		}
+		if traceFile != "" {
+			if err := trace.WriteFile(traceFile); err != nil {
+				log.Printf("writing trace: %v", err)
+			} else {
+				log.Printf("trace written to %s", traceFile)
+			}
+		}
+		if err != nil {
+			log.Printf("error: %s\n", err)
+			return 2
 		}
 		outcome := 0
 		if totalFailures == 0 {
@@ -96,6 +233,51 @@ func submain() int { // return exit code
 	return 2
 }
 
+// Open the Nano on port, which resets it, and create a session with it.
+// The Nano is described as what in errors.
+func openNano(what string, port string) (*dev.Arduino, error) {
+	nano, err := dev.NewArduino(port, baudRate, nanoLog, debug)
+	if err != nil {
+		return nil, fmt.Errorf("opening %s %s: %v", what, port, err)
+	}
+	nano.SetResponseTimeout(responseTimeout)
+	if lowLatency {
+		nano.SetLowLatency()
+	}
+	if err := dev.CreateSession(nano); err != nil {
+		nano.Close()
+		return nil, fmt.Errorf("creating session with %s %s: %v", what, port, err)
+	}
+	return nano, nil
+}
+
+// The number of times -jitter times each register access in each mode.
+const jitterReps = 4096
+
+// Log the range of CPU cycles each register access takes on the Nano
+// with interrupts enabled and with them masked. The difference between
+// the least and most is the jitter an ISR adds. The timing mode is off
+// afterward.
+func reportJitter(nano *dev.Arduino) error {
+	for _, atomic := range []bool{false, true} {
+		if err := dev.SetAtomicBus(nano, atomic); err != nil {
+			return err
+		}
+		j, err := dev.MeasureJitter(nano, jitterReps)
+		if err != nil {
+			return err
+		}
+		mode := "interrupts enabled"
+		if atomic {
+			mode = "interrupts masked"
+		}
+		log.Printf("bus cycles with %s (least-most): pulse %d-%d set %d-%d read %d-%d, overhead %d-%d",
+			mode, j.Pulse.Least, j.Pulse.Most, j.Set.Least, j.Set.Most,
+			j.Read.Least, j.Read.Most, j.Empty.Least, j.Empty.Most)
+	}
+	return dev.SetAtomicBus(nano, false)
+}
+
 // Conduct an interactive session with the Nano.
 //
 // Errors:
@@ -123,21 +305,21 @@ func interactiveSession(input *Input, nano *dev.Arduino) error {
 	}
 }
 
-// These doSomeCmd functions are used by both interactive mode
-// and vector mode. Since they are used interactively, the just
-// print messages for syntax errors, but don't return errors
-// because those would end the session with the Nano.
+// These doSomeCmd functions parse the interactive commands and
+// hand them to the typed register operations in package dev. Since
+// they are used interactively, they just print messages for syntax
+// errors, but don't return errors because those would end the
+// session with the Nano. Vector mode calls package dev directly.
 
 func doToggleCmd(line string, nano *dev.Arduino) error {
-	var cmd []byte = make([]byte, 3, 3)
-	// t id count
-	n, err := fmt.Sscanf(line[2:], "%x %x", &cmd[1], &cmd[2])
-	if n != 2 { // print a message and do nothing
+	var count, id byte
+	// t count id
+	if n, _ := fmt.Sscanf(line[2:], "%x %x", &count, &id); n != 2 || id > byte(dev.MaxRegisterID) {
+		// print a message and do nothing
 		log.Printf("usage: t hexct hexid")
 		return nil
 	}
-	cmd[0] = dev.CmdPulse
-	_, err = dev.DoFixedCommand(nano, cmd, 0)
+	err := dev.Pulse(nano, dev.RegisterID(id), count)
 	if err == nil && debug {
 		log.Printf("%s", line)
 	}
@@ -145,20 +327,18 @@ func doToggleCmd(line string, nano *dev.Arduino) error {
 }
 
 func doSetCmd(line string, nano *dev.Arduino) error {
-	var cmd []byte = make([]byte, 3, 3)
+	var id, data byte
 	// s id data or sr id data for bit-reversed set
-	var cmdByte byte = dev.CmdSet
+	reversed := line[1] == 'r'
 	offset := 2
-	if line[1] == 'r' {
-		cmdByte = dev.CmdSetR
+	if reversed {
 		offset = 3
 	}
-	if n, _ := fmt.Sscanf(line[offset:], "%x %x", &cmd[1], &cmd[2]); n != 2 {
+	if n, _ := fmt.Sscanf(line[offset:], "%x %x", &id, &data); n != 2 || id > byte(dev.MaxRegisterID) {
 		log.Printf("usage: s hexid hexdata or sr hexid hexdata")
 		return nil
 	}
-	cmd[0] = cmdByte
-	_, err := dev.DoFixedCommand(nano, cmd, 0)
+	err := dev.SetRegister(nano, dev.RegisterID(id), data, reversed)
 	if err == nil && debug {
 		log.Printf("%s", line)
 	}
@@ -168,25 +348,21 @@ func doSetCmd(line string, nano *dev.Arduino) error {
 func doGetCmd(line string, nano *dev.Arduino) (byte, error) {
 	// Note: this just reads the reads the input register.
 	// It must be separately clocked using a "t" command.
-	var cmd []byte = make([]byte, 2, 2)
+	var id byte
 	// g id or gr id for bit-reversed get
-	var cmdByte byte = dev.CmdGet
+	reversed := line[1] == 'r'
 	offset := 2
-	if line[1] == 'r' {
-		cmdByte = dev.CmdGetR
+	if reversed {
 		offset = 3
 	}
-	n, err := fmt.Sscanf(line[offset:], "%x", &cmd[1])
-	if n != 1 {
+	if n, _ := fmt.Sscanf(line[offset:], "%x", &id); n != 1 || id > byte(dev.MaxRegisterID) {
 		log.Printf("usage: g hexid or gr hexid")
 		return 0, nil
 	}
-	cmd[0] = cmdByte
-	sl, err := dev.DoFixedCommand(nano, cmd, 1)
+	result, err := dev.GetRegister(nano, dev.RegisterID(id), reversed)
 	if err != nil {
 		return 0, err
 	}
-	result := sl[0]
 	if debug {
 		log.Printf("%s = %02X", line, result)
 	}
@@ -0,0 +1,231 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+
+package main
+
+// Vector stream optimizer.
+//
+// Applied naively, every PLCC vector writes all six output registers and
+// captures and reads all three input registers, 48 bytes on the link (52
+// if clocked). But the output registers hold their values, so a register
+// whose value hasn't changed since it was last written need not be written
+// again; and an input register whose bits are all X in the vector need not
+// be captured or read at all.
+//
+// The optimizer makes a plan for an image: the order in which its records
+// are applied and, for each vector, which output registers to write and
+// which input registers to read. The register state is unknown at the
+// start of every file, so the first vector of each file writes everything.
+//
+// Optionally the optimizer also reorders vectors to reduce the number of
+// register changes. Only runs of unclocked vectors may be reordered; a
+// clocked vector, a vector with clock phases, or a log comment, is a
+// barrier that nothing moves across.
+// This can only be correct if the UUT is combinational between clocks, so
+// it is not the default.
+
+import (
+	"log"
+	"math/bits"
+
+	"cex/dev"
+)
+
+// Input registers in the reads mask of a step. The order is
+// the order in which they are captured and read.
+const (
+	readU11 = 1 << iota // C, P, G, Z, V flags
+	readU3              // F<15:8>
+	readU7              // F<7:0>
+
+	readAll = readU11 | readU3 | readU7
+)
+
+// All the output registers in the writes mask of a step. Bit i
+// corresponds to drive byte i of the record.
+const writeAll = 1<<(plccU2+1) - 1
+
+// Link bytes (both directions) of the PLCC commands.
+const (
+	bytesPerSet   = 3 + 1                     // command, id, data; ack
+	bytesPerPulse = 3 + 1                     // command, count, id; ack
+	bytesPerRead  = bytesPerPulse + 2 + 1 + 1 // capture; command, id; ack, data
+)
+
+// Return the link bytes (both directions) of the commands in cb: the
+// commands, an ack for each, and their results.
+func linkBytes(cb *dev.CommandBuffer) int {
+	return len(cb.Bytes()) + cb.Commands() + cb.Responses()
+}
+
+// One step of a plan: apply record number record of the image
+// writing and reading only the registers in the masks.
+type vectorStep struct {
+	record int
+	writes byte
+	reads  byte
+}
+
+type optimizerStats struct {
+	vectors      int
+	writesElided int
+	readsElided  int
+	moved        int
+	bytesBefore  int
+	bytesAfter   int
+	applied      bool // vectors were applied with CmdApply
+	linkBytes    int  // link bytes of the vectors' commands, if applied
+	tabled       int  // vectors sent in vector tables
+	tableOut     int  // link bytes of the tables to the Nano
+	tableIn      int  // and from it
+}
+
+// Make the plan for applying img. If optimize is false, the plan applies
+// every record in order, writing and reading every register.
+func planImage(img *vectorImage, optimize bool, reorder bool) ([]vectorStep, optimizerStats) {
+	var stats optimizerStats
+	var r vectorRecord
+	plan := make([]vectorStep, img.Len())
+
+	for i := range plan {
+		plan[i] = vectorStep{record: i, writes: writeAll, reads: readAll}
+	}
+	if !optimize || img.socket != socketPLCC {
+		return plan, stats
+	}
+
+	if reorder {
+		stats.moved = reorderSteps(img, plan)
+	}
+
+	var shadow [6]byte
+	valid := byte(0) // shadow[i] is known if bit i is set
+	for i := range plan {
+		step := &plan[i]
+		img.Record(step.record, &r)
+		if r.kind != recordVector {
+			continue
+		}
+		stats.vectors++
+		stats.bytesBefore += bits.OnesCount8(writeAll)*bytesPerSet + 3*bytesPerRead
+		if r.clocked() {
+			stats.bytesBefore += bytesPerPulse
+			stats.bytesAfter += bytesPerPulse
+		}
+
+		step.writes = 0
+		for j := range r.drive {
+			if valid&(1<<j) == 0 || shadow[j] != r.drive[j] {
+				step.writes |= 1 << j
+				shadow[j] = r.drive[j]
+				valid |= 1 << j
+			} else {
+				stats.writesElided++
+			}
+		}
+
+		step.reads = 0
+		if r.mask[2] != 0 {
+			step.reads |= readU11
+		}
+		if r.mask[0] != 0 {
+			step.reads |= readU3
+		}
+		if r.mask[1] != 0 {
+			step.reads |= readU7
+		}
+		stats.readsElided += 3 - bits.OnesCount8(step.reads)
+		stats.bytesAfter += bits.OnesCount8(step.writes)*bytesPerSet + bits.OnesCount8(step.reads)*bytesPerRead
+	}
+	return plan, stats
+}
+
+// Reorder each run of unclocked vectors in plan so that each vector is
+// followed by the remaining one that differs from it in the fewest output
+// registers. Return the number of vectors that moved.
+func reorderSteps(img *vectorImage, plan []vectorStep) int {
+	var r vectorRecord
+	moved := 0
+	for start := 0; start < len(plan); {
+		// Find the run [start, end) of unclocked vectors
+		end := start
+		for ; end < len(plan); end++ {
+			img.Record(plan[end].record, &r)
+			if r.kind != recordVector || r.clocked() || hasPhases(img, plan[end].record) {
+				break
+			}
+		}
+		if end-start > 2 {
+			moved += reorderRun(img, plan[start:end])
+		}
+		start = end + 1
+	}
+	return moved
+}
+
+// Return whether the vector at record i of img is followed by clock
+// phases.
+func hasPhases(img *vectorImage, i int) bool {
+	var r vectorRecord
+	if i+1 >= img.Len() {
+		return false
+	}
+	img.Record(i+1, &r)
+	return r.kind == recordPhase
+}
+
+// Greedy nearest neighbor ordering of one run. The first vector stays
+// first because the register state before the run is the state left by
+// whatever came before it, which we don't track here.
+func reorderRun(img *vectorImage, run []vectorStep) int {
+	drives := make([][6]byte, len(run))
+	var r vectorRecord
+	for i := range run {
+		img.Record(run[i].record, &r)
+		drives[i] = r.drive
+	}
+
+	moved := 0
+	for i := 1; i < len(run); i++ {
+		best, bestCost := i, 7
+		for j := i; j < len(run); j++ {
+			cost := 0
+			for k := range drives[j] {
+				if drives[j][k] != drives[i-1][k] {
+					cost++
+				}
+			}
+			if cost < bestCost {
+				best, bestCost = j, cost
+			}
+		}
+		if best != i {
+			run[i], run[best] = run[best], run[i]
+			drives[i], drives[best] = drives[best], drives[i]
+			moved++
+		}
+	}
+	return moved
+}
+
+func (stats *optimizerStats) report(path string) {
+	if stats.tabled != 0 {
+		applyOut := stats.tabled * (2 + dev.LayoutNWrites)
+		log.Printf("vector file %s: %d vectors sent in tables as %d link bytes to the Nano rather than %d (%.1fx), and %d link bytes back",
+			path, stats.tabled, stats.tableOut, applyOut, float64(applyOut)/float64(stats.tableOut), stats.tableIn)
+	}
+	if stats.vectors == 0 {
+		return
+	}
+	if stats.applied {
+		// Elided writes don't shorten a CmdApply, so what the vectors
+		// save is the format's doing, not the optimizer's.
+		log.Printf("vector file %s: %d vectors sent as %d link bytes rather than %d with separate commands (%.1fx), %d vectors reordered",
+			path, stats.vectors, stats.linkBytes, stats.bytesBefore, float64(stats.bytesBefore)/float64(stats.linkBytes), stats.moved)
+		return
+	}
+	saved := stats.bytesBefore - stats.bytesAfter
+	log.Printf("vector file %s: optimizer saved %d of %d link bytes (%d%%): "+
+		"%d register writes and %d reads elided, %d vectors reordered",
+		path, saved, stats.bytesBefore, 100*saved/stats.bytesBefore,
+		stats.writesElided, stats.readsElided, stats.moved)
+}
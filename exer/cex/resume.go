@@ -0,0 +1,134 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+
+package main
+
+// Resuming a run after the link fails.
+//
+// A long run of vector files can be lost to a moment's trouble on the
+// USB link or a reset of the Nano. With -reconnect n, cex instead closes
+// the port, opens it again, which resets the Nano, creates a new session,
+// and resumes the run from its last checkpoint, up to n times.
+//
+// The end of each vector file is a checkpoint. Within a file, if vectors
+// are applied with CmdApply or CmdReplay and the firmware has
+// CmdCheckpoint, the encoder adds checkpoint items: one after every
+// checkpointVectors vectors, and one after each vector or table of
+// vectors that clocks the device. Each flushes a pipelined vector or a
+// table first, then asks the Nano how many vectors it has applied since
+// the last checkpoint and what its output registers hold. The link
+// compares the answer with what was sent. A Nano that has reset or lost
+// a command won't agree, and that fails the run as a timeout would. If
+// it does agree, every vector before the checkpoint has been applied and
+// checked, and the checker records where the run stands: the file and
+// plan step, the failures so far, the state of the random inputs of
+// -lfsr, and the data in the output registers.
+//
+// On resuming, the file's layout is set again and a CmdApply with
+// ApplyWriteAll puts the data back in the output registers, since the
+// Nano sets U10 when it starts. The device in the socket keeps its
+// state, so vectors after the checkpoint that were applied before the
+// link failed are applied again. That's harmless for a vector that
+// doesn't clock the device: it's checked and logged again, but its
+// failures are only counted once. A vector that clocks would advance the
+// device a second time. So the link collects everything in flight before
+// it sends one, and the checker notes the vector until the checkpoint
+// after it is recorded. If the link fails in between, the vector may or
+// may not have been applied, and cex doesn't resume. A sequential test
+// therefore resumes only if the link fails while no clocked vector is in
+// doubt, and one that clocks on every vector rarely resumes at all.
+// Without CmdCheckpoint, a file resumes only if none of its vectors has
+// clocked yet. With -golden, both Nanos are reconnected; with -coverage,
+// the coverage of a resumed file starts again at the checkpoint.
+
+import (
+	"fmt"
+
+	"cex/dev"
+)
+
+// The most vectors between checkpoints within a file.
+const checkpointVectors = 256
+
+// Where a run stands. The files before file are done, and so are the
+// steps of its plan before step.
+type checkpoint struct {
+	file     int
+	step     int  // 0 at the start of the file
+	line     int  // of the last vector before step
+	failures int  // in the file before step
+	total    int  // in the files before file
+	random   lfsr // the -lfsr inputs after the last vector, if not zero
+	clocked  int  // line of the first vector after step that clocked, if any
+
+	// The output registers (the write slots of the layout) that hold
+	// known data, and the data.
+	valid  byte
+	shadow [dev.LayoutNWrites]byte
+}
+
+// An error of the link to a Nano or of the Nano itself, rather than of
+// the vector files. A run that fails with one can be resumed.
+type linkError struct {
+	error
+}
+
+func isLinkError(err error) bool {
+	_, ok := err.(linkError)
+	return ok
+}
+
+// Describe where the run will resume, for the log.
+func (cp *checkpoint) describe(paths []string) string {
+	if cp.step == 0 {
+		return fmt.Sprintf("at the start of vector file %s", paths[cp.file])
+	}
+	return fmt.Sprintf("in vector file %s after line %d", paths[cp.file], cp.line)
+}
+
+// Compare the results of the CmdCheckpoint of the checkpoint item it
+// with what the encoder sent since the last one: the number of vectors,
+// and the data of the last, which the output registers should hold.
+func verifyCheckpoint(it *vectorItem, results []byte) error {
+	applied := uint16(results[dev.CheckpointApplied]) | uint16(results[dev.CheckpointApplied+1])<<8
+	if applied != it.applied {
+		return fmt.Errorf("the Nano applied %d vectors since the last checkpoint, not %d", applied, it.applied)
+	}
+	valid := results[dev.CheckpointValid]
+	for i := 0; i < dev.LayoutNWrites; i++ {
+		got := results[dev.CheckpointShadow+i]
+		if valid&(1<<i) != 0 && got != it.drive[i] {
+			return fmt.Errorf("the Nano's write slot %d holds 0x%02X, not 0x%02X", i, got, it.drive[i])
+		}
+	}
+	return nil
+}
+
+// Verify the results of the checkpoint item it, and if differential,
+// those of the golden device. Return false, with it.err set, if the
+// item failed or either device disagrees with what was sent.
+func (it *vectorItem) confirmCheckpoint(differential bool) bool {
+	if it.err == nil {
+		it.err = verifyCheckpoint(it, it.results[:])
+	}
+	if it.err == nil && differential && it.golden.err == nil {
+		if err := verifyCheckpoint(it, it.golden.results[:]); err != nil {
+			it.err = fmt.Errorf("golden device: %v", err)
+		}
+	}
+	return it.err == nil
+}
+
+// Record the checkpoint item it, whose results have been verified, in
+// cp. The failures are those of the file and the files before it.
+func (cp *checkpoint) record(it *vectorItem, total int) {
+	*cp = checkpoint{
+		file:     it.file.index,
+		step:     it.step,
+		line:     it.line,
+		failures: it.file.failures,
+		total:    total,
+		random:   it.random,
+		valid:    it.results[dev.CheckpointValid],
+	}
+	copy(cp.shadow[:], it.results[dev.CheckpointShadow:])
+}
@@ -0,0 +1,869 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+
+package main
+
+// Concurrent processing of vector files.
+//
+// Processing the vector files named on the command line has four stages,
+// each in its own goroutine, connected by channels:
+//
+//   loader:  compiles (or maps the cached image of) each file and plans
+//            it, one file ahead of the encoder
+//   encoder: encodes the commands for each vector of the plan
+//   link:    sends the commands through a dev.Pipeline and collects
+//            the results as they arrive
+//   checker: compares results with expected values and writes the log
+//
+// So the host's work on later vectors and files is hidden behind the
+// device's work on earlier ones. Everything that reaches the checker
+// arrives in plan order, which is line number order unless -reorder was
+// given, so the log is in the same order as the vector files. Log
+// comments and file boundaries travel through the stages as items like
+// vectors, so they don't stall the link.
+//
+// Items are recycled from the checker back to the encoder. The size of
+// the item pool limits how far the encoder can run ahead of the device.
+//
+// If the firmware has CmdApply, each vector is one command, using a
+// layout of the registers for the file's socket that travels with the
+// file's first item. ZIF vectors require it, since the Nano sequences
+// the output enables that set the direction of the ZIF pins. With
+// -pipelined, each vector's results come back with the next vector's
+// command, so the Nano reads one vector's captures and writes the next
+// one's registers in a single turnaround of its data port. The encoder
+// then follows the last vector before anything else (a comment or the
+// end of the file) with a flush, so no item waits on a vector that may
+// never come.
+//
+// With -replay, vectors are instead added to a dev.VectorTable. When
+// it's full, or at a comment, a vector with clock phases, or the end of
+// the file, the encoder sends it with a flush item whose commands load
+// the Nano's vector table, compressed, and replay it. The flush item
+// hands the packed results out to the vectors of its batch.
+//
+// A vector with more than one clock pulse or with clock phases ('+'
+// lines) writes its inputs with CmdApply and then runs its phases with
+// one CmdClocks. Such a vector isn't pipelined; the encoder flushes
+// before it.
+//
+// With -golden, every item also goes to a second Nano holding a known
+// good chip, and the checker compares the candidate's results with it
+// rather than with the vector file; see diff.go.
+//
+// With -coverage, the link also fetches the Nano's pin coverage at the
+// end of each file; see coverage.go.
+//
+// With -reconnect, the encoder adds checkpoints, and the checker records
+// the last one that the Nano confirms, so a run whose link fails can be
+// resumed from it. The link collects everything in flight and verifies
+// the checkpoints before it sends a vector that clocks the device, so
+// the checker knows of every clocked vector that might be applied again
+// by resuming; see resume.go.
+//
+// If the Arduino has a trace (-trace), each stage records its spans in
+// it and the Nano is put in trace mode. The Nano can only hold a few
+// command records, so the link drains the pipeline and fetches them
+// whenever the next vector might overflow them. This costs some of the
+// overlap that tracing is supposed to show, but only at those points.
+
+import (
+	"fmt"
+	"log"
+	"math/bits"
+	"time"
+
+	"cex/dev"
+)
+
+const itemPoolSize = 64
+
+// The most results an item's commands return: those of a CmdApply
+// and a CmdClocks.
+const itemResults = dev.ApplyResults + dev.ClockResults
+
+type itemKind byte
+
+const (
+	itemFileStart itemKind = iota
+	itemComment
+	itemVector
+	itemFileEnd
+	itemError
+	itemFlush      // returns the results of the last pipelined vector
+	itemCheckpoint // reports the Nano's state to resume from
+	itemRestore    // restores the output registers on resuming
+)
+
+// How vectors are applied.
+type applyMode byte
+
+const (
+	applyCommands  applyMode = iota // separate set, pulse, and get commands
+	applyDirect                     // CmdApply
+	applyPipelined                  // CmdApply, results one vector behind
+	applyReplay                     // CmdLoad and CmdReplay, a table at a time
+)
+
+// A loadedFile is the output of the loader stage.
+type loadedFile struct {
+	path     string
+	index    int // in the run
+	start    int // the plan step to start at, if the run is resumed
+	img      *vectorImage
+	plan     []vectorStep
+	stats    optimizerStats
+	failures int
+	err      error
+}
+
+// A vectorItem is passed from stage to stage. Only the fields
+// appropriate to its kind are meaningful.
+type vectorItem struct {
+	kind     itemKind
+	file     *loadedFile
+	line     int
+	text     string             // comment text
+	socket   byte               // socketPLCC or socketZIF
+	commands *dev.CommandBuffer // commands for the Nano; owned by the item
+	check    vectorCheck        // what to expect of the results
+	clocks   bool               // the commands pulse the clock
+	results  [itemResults]byte  // results from the device
+	done     bool               // results have arrived
+	err      error
+
+	// A vector applied with CmdClocks has a check for each of its clock
+	// phases after the first, from that phase's line. Its results follow
+	// those of the CmdApply that wrote its inputs.
+	phased      bool
+	phases      int
+	phaseLines  [dev.ClockPhases - 1]int
+	phaseChecks [dev.ClockPhases - 1]vectorCheck
+
+	// In pipelined mode, the commands return the results of resultsFor,
+	// the previous vector, if any.
+	pipelined  bool
+	resultsFor *vectorItem
+
+	// In replay mode, a vector's results come from the flush item that
+	// replays its table, whose batch holds the table's vectors.
+	batched bool
+	batch   []*vectorItem
+
+	// In differential mode, the results of the golden device, and for
+	// a vector with random inputs, its variant number (from 1) and the
+	// inputs.
+	golden  goldenResults
+	variant int
+	drive   [6]byte
+
+	// A checkpoint holds the plan step after it, the vectors applied
+	// since the last checkpoint, with the data of the last in drive,
+	// and the state of the random inputs. So does a file end, except
+	// for the vectors.
+	step    int
+	applied uint16
+	random  lfsr
+}
+
+// Receive the results of the item's commands from the pipeline.
+// This implements dev.Completion.
+func (it *vectorItem) Complete(results []byte, err error) {
+	deliverResults(it, func(v *vectorItem) resultSink { return v }, results, err)
+}
+
+// Where the results of an item's commands from one device go: the item
+// itself, or in differential mode, its golden results.
+type resultSink interface {
+	complete(results []byte, err error)
+}
+
+// Hand out the results of the commands of it to the items they belong
+// to, completing the sink of each that sink returns. A flush item's
+// results are those of its batch, or of the vector before it, as are a
+// pipelined vector's.
+func deliverResults(it *vectorItem, sink func(*vectorItem) resultSink, results []byte, err error) {
+	if len(it.batch) != 0 {
+		for _, v := range it.batch {
+			var own []byte
+			own, results = splitResults(v, results)
+			sink(v).complete(own, err)
+		}
+		sink(it).complete(nil, err)
+		return
+	}
+	if !it.pipelined {
+		sink(it).complete(results, err)
+		return
+	}
+	if it.resultsFor != nil {
+		sink(it.resultsFor).complete(results, err)
+	}
+	if err != nil || it.kind == itemFlush {
+		sink(it).complete(nil, err)
+	}
+}
+
+func (it *vectorItem) complete(results []byte, err error) {
+	copy(it.results[:], results)
+	it.err = err
+	it.done = true
+}
+
+// Return the results of the vector v from the start of the packed
+// results of a CmdReplay, and the rest.
+func splitResults(v *vectorItem, results []byte) ([]byte, []byte) {
+	n := bits.OnesCount8(v.check.reads)
+	if len(results) < n {
+		return nil, nil
+	}
+	return results[:n], results[n:]
+}
+
+// Process the vector files, starting from progress, which is updated as
+// the run goes on. Return the total number of hardware failures detected
+// and an error. Hardware failures are not "errors". If golden isn't nil,
+// the vectors are applied to it as well, and the failures are the
+// differences between the two devices. If the error is a linkError, the
+// run can be resumed from progress.
+func DoVectorFiles(paths []string, nano *dev.Arduino, golden *dev.Arduino, progress *checkpoint) (int, error) {
+	quit := make(chan struct{})
+	defer close(quit)
+
+	free := make(chan *vectorItem, itemPoolSize)
+	for i := 0; i < itemPoolSize; i++ {
+		it := &vectorItem{commands: dev.NewCommandBuffer()}
+		it.golden.it = it
+		free <- it
+	}
+	files := make(chan *loadedFile, 1)
+	encoded := make(chan *vectorItem, itemPoolSize)
+	checked := make(chan *vectorItem, itemPoolSize)
+
+	// In differential mode, both devices must be able to do anything
+	// the vectors are encoded to use.
+	differential := golden != nil
+	has := func(bits uint16) bool {
+		return nano.Caps().Has(bits) && (!differential || golden.Caps().Has(bits))
+	}
+
+	mode := applyCommands
+	if has(dev.CapApply) {
+		mode = applyDirect
+		if pipelined {
+			mode = applyPipelined
+		}
+	} else if pipelined {
+		log.Printf("-pipelined ignored: the firmware can't apply vectors")
+	}
+	if replay {
+		if has(dev.CapApply | dev.CapReplay) {
+			mode = applyReplay
+		} else {
+			log.Printf("-replay ignored: the firmware has no vector table")
+		}
+	}
+
+	trace := nano.Trace()
+	traceRecords := 0
+	if trace != nil {
+		var err error
+		if traceRecords, err = dev.EnableTrace(nano, true); err != nil {
+			log.Printf("tracing the host only: %v", err)
+		}
+	}
+
+	checkpoints := false
+	if reconnects != 0 {
+		checkpoints = mode != applyCommands && has(dev.CapCheckpoint)
+		if !checkpoints {
+			log.Printf("-reconnect resumes only at the start of a file: the firmware can't report checkpoints")
+		}
+	}
+
+	from := *progress
+	go loader(paths, from, files, differential, trace, quit)
+	zif := has(dev.CapApply | dev.CapEnables)
+	clocks := has(dev.CapApply | dev.CapClocks)
+	chunk := dev.LoadChunk(nano.Caps().Window())
+	if differential {
+		if c := dev.LoadChunk(golden.Caps().Window()); c < chunk {
+			chunk = c
+		}
+	}
+	go encoder(files, free, encoded, mode, zif, clocks, differential, chunk, checkpoints, from, trace, quit)
+	var cover *runCoverage
+	if coverage {
+		if nano.Caps().Has(dev.CapCoverage) {
+			cover = &runCoverage{}
+		} else {
+			log.Printf("-coverage ignored: the firmware doesn't keep coverage")
+		}
+	}
+
+	go link(nano, golden, encoded, checked, traceRecords, cover, reconnects != 0, quit)
+	totalFailures, err := checker(checked, free, differential, progress)
+	if err == nil && cover != nil {
+		cover.report()
+	}
+	return totalFailures, err
+}
+
+// Loader stage: compile and plan each file in turn, starting where from
+// says. A differential test reads every register, so its plan isn't
+// optimized.
+func loader(paths []string, from checkpoint, out chan<- *loadedFile, differential bool, trace *dev.Trace, quit <-chan struct{}) {
+	defer close(out)
+	for i := from.file; i < len(paths); i++ {
+		path := paths[i]
+		start := time.Now()
+		f := &loadedFile{path: path, index: i}
+		if i == from.file {
+			f.start, f.failures = from.step, from.failures
+		}
+		f.img, f.err = loadImage(path)
+		if f.err == nil {
+			f.plan, f.stats = planImage(f.img, optimize && !differential, reorder && !differential)
+		}
+		trace.Span(dev.TraceLoader, "load", path, start)
+		select {
+		case out <- f:
+		case <-quit:
+			return
+		}
+		if f.err != nil {
+			return
+		}
+	}
+}
+
+// Encoder stage: turn each step of each file's plan into an item. If zif
+// is false, the firmware can't apply ZIF vectors, and if clocks is false,
+// it can't apply clock phases. If differential, every output is checked,
+// and each PLCC vector without phases is followed by lfsrVariants copies
+// of it with random A and B inputs. In replay mode, each CmdLoad carries
+// at most chunk bytes. If checkpoints, a checkpoint follows every
+// checkpointVectors vectors or so. If the run is resumed, the encoder
+// starts from the random inputs and output registers of from.
+func encoder(in <-chan *loadedFile, free <-chan *vectorItem, out chan<- *vectorItem, mode applyMode, zif bool, clocks bool, differential bool, chunk int, checkpoints bool, from checkpoint, trace *dev.Trace, quit <-chan struct{}) {
+	defer close(out)
+
+	// Get a free item, or nil if we're quitting.
+	get := func(f *loadedFile, kind itemKind) *vectorItem {
+		select {
+		case it := <-free:
+			it.kind, it.file, it.line, it.text = kind, f, 0, ""
+			it.done, it.err = false, nil
+			it.golden.done, it.golden.err = false, nil
+			it.variant = 0
+			it.pipelined, it.resultsFor = false, nil
+			it.batched, it.batch = false, it.batch[:0]
+			it.phased, it.phases = false, 0
+			it.step, it.applied, it.random = 0, 0, 0
+			it.clocks = false
+			it.commands.Reset()
+			return it
+		case <-quit:
+			return nil
+		}
+	}
+	put := func(it *vectorItem) bool {
+		select {
+		case out <- it:
+			return true
+		case <-quit:
+			return false
+		}
+	}
+
+	// The last pipelined vector, whose results haven't been asked for,
+	// or in replay mode, the vectors in the table.
+	var last *vectorItem
+	var table *dev.VectorTable
+	var batch []*vectorItem
+	if mode == applyReplay {
+		table = dev.NewVectorTable()
+	}
+	flush := func(f *loadedFile) bool {
+		if last == nil && len(batch) == 0 {
+			return true
+		}
+		it := get(f, itemFlush)
+		if it == nil {
+			return false
+		}
+		if last != nil {
+			it.line = last.line
+			it.pipelined, it.resultsFor = true, last
+			encodeFlush(it.commands)
+			f.stats.linkBytes += linkBytes(it.commands)
+			last = nil
+		} else {
+			it.line = batch[len(batch)-1].line
+			it.batch = append(it.batch, batch...)
+			for _, v := range batch {
+				it.clocks = it.clocks || v.clocks
+			}
+			table.Encode(it.commands, chunk)
+			f.stats.linkBytes += linkBytes(it.commands)
+			f.stats.tabled += table.Len()
+			f.stats.tableOut += len(it.commands.Bytes())
+			f.stats.tableIn += it.commands.Commands() + it.commands.Responses()
+			table.Reset()
+			batch = batch[:0]
+		}
+		return put(it)
+	}
+
+	// Encode the vector r, which has no phases and is the given step
+	// of the plan, into it.
+	encodeVector := func(it *vectorItem, r *vectorRecord, step *vectorStep) {
+		if it.socket == socketPLCC && mode == applyCommands {
+			it.check = encodePLCC(it.commands, r, step)
+			return
+		}
+		if mode == applyReplay {
+			var ctl byte
+			if it.socket == socketPLCC {
+				ctl = plccApplyControl(r, step, false)
+			} else {
+				ctl = zifApplyControl(r, false)
+			}
+			table.Add(ctl, &r.drive)
+			it.check = vectorCheck{r.expect, r.mask, ctl & dev.ApplyReads}
+			it.batched = true
+			batch = append(batch, it)
+			return
+		}
+		it.pipelined = mode == applyPipelined
+		if it.socket == socketPLCC {
+			it.check = encodePLCCApply(it.commands, r, step, it.pipelined)
+		} else {
+			it.check = encodeZIFApply(it.commands, r, it.pipelined)
+		}
+		if it.pipelined {
+			it.resultsFor, last = last, it
+		}
+	}
+
+	random := lfsr(lfsrSeed)
+	if from.random != 0 {
+		random = from.random
+	}
+
+	// The vectors the Nano has been sent since the last checkpoint, the
+	// last one's line and data, and whether any of them clocked.
+	var applied uint16
+	var line int
+	var drive [dev.LayoutNWrites]byte
+	var clocked bool
+	sent := func(it *vectorItem, r *vectorRecord) {
+		applied++
+		line, drive = r.line, r.drive
+		clocked = clocked || it.clocks
+	}
+
+	// Follow the vectors so far with a checkpoint that resumes at step
+	// i, flushing them first.
+	addCheckpoint := func(f *loadedFile, i int) bool {
+		if !flush(f) {
+			return false
+		}
+		it := get(f, itemCheckpoint)
+		if it == nil {
+			return false
+		}
+		it.line, it.step, it.random = line, i, random
+		it.applied, it.drive = applied, drive
+		it.commands.Checkpoint()
+		applied, clocked = 0, false
+		return put(it)
+	}
+
+	var r vectorRecord
+	for f := range in {
+		if f.err != nil {
+			if it := get(f, itemError); it != nil {
+				it.err = f.err
+				put(it)
+			}
+			return
+		}
+
+		if f.img.socket == socketZIF && !zif {
+			if it := get(f, itemError); it != nil {
+				it.err = fmt.Errorf("the firmware can't apply ZIF vectors")
+				put(it)
+			}
+			return
+		}
+
+		f.stats.applied = mode != applyCommands
+		it := get(f, itemFileStart)
+		if it == nil {
+			return
+		}
+		if mode != applyCommands {
+			if f.img.socket == socketPLCC {
+				encodePLCCLayout(it.commands)
+			} else {
+				encodeZIFLayout(it.commands)
+			}
+		}
+		if f.start != 0 {
+			it.line = from.line
+		}
+		applied, clocked = 0, false // the layout clears the Nano's count
+		if !put(it) {
+			return
+		}
+		if f.start != 0 && from.valid != 0 {
+			if it = get(f, itemRestore); it == nil {
+				return
+			}
+			it.line = from.line
+			it.commands.Apply(dev.ApplyWriteAll, &from.shadow)
+			applied++
+			drive = from.shadow
+			if !put(it) {
+				return
+			}
+		}
+		for i := f.start; i < len(f.plan); i++ {
+			f.img.Record(f.plan[i].record, &r)
+
+			// A vector or table that clocks the device is confirmed
+			// before anything follows it, so resuming never clocks
+			// it twice unnoticed.
+			due := applied >= checkpointVectors || clocked && len(batch) == 0
+			if checkpoints && due && r.kind != recordPhase && !addCheckpoint(f, i) {
+				return
+			}
+			kind := itemVector
+			phased := false
+			switch {
+			case r.kind == recordComment:
+				kind = itemComment
+				if !flush(f) {
+					return
+				}
+			case r.kind == recordPhase:
+				continue // applied with its vector
+			case r.clocks > 1 || hasPhases(f.img, f.plan[i].record):
+				if mode == applyCommands || !clocks {
+					if it := get(f, itemError); it != nil {
+						it.err = fmt.Errorf("line %d: the firmware can't apply clock phases", r.line)
+						put(it)
+					}
+					return
+				}
+				phased = true
+				if checkpoints && clocked {
+					if !addCheckpoint(f, i) {
+						return
+					}
+				} else if !flush(f) {
+					return
+				}
+			}
+			if it = get(f, kind); it == nil {
+				return
+			}
+			start := time.Now()
+			it.line = r.line
+			it.socket = f.img.socket
+			if differential && kind == itemVector {
+				r.mask = outputMask(it.socket, &r)
+			}
+			if kind == itemComment {
+				it.text = f.img.Comment(&r)
+			} else if phased {
+				it.phased = true
+				it.check = encodeClockPhases(it, f.img, f.plan, i, &r, differential)
+			} else {
+				encodeVector(it, &r, &f.plan[i])
+			}
+			if kind == itemVector {
+				it.clocks = phased || r.clocked()
+				sent(it, &r)
+				f.stats.linkBytes += linkBytes(it.commands)
+			}
+			trace.Span(dev.TraceEncoder, "encode", "", start)
+			if !put(it) {
+				return
+			}
+			if table != nil && table.Full() && !flush(f) {
+				return
+			}
+			if !differential || kind != itemVector || phased || it.socket != socketPLCC {
+				continue
+			}
+			for n := 1; n <= lfsrVariants; n++ {
+				if it = get(f, itemVector); it == nil {
+					return
+				}
+				start := time.Now()
+				it.line, it.variant = r.line, n
+				it.socket = f.img.socket
+				randomizeInputs(&r, &random)
+				it.drive = r.drive
+				encodeVector(it, &r, &f.plan[i])
+				it.clocks = r.clocked()
+				sent(it, &r)
+				trace.Span(dev.TraceEncoder, "encode", "", start)
+				if !put(it) {
+					return
+				}
+				if table != nil && table.Full() && !flush(f) {
+					return
+				}
+			}
+		}
+		f.img.Close()
+
+		if !flush(f) {
+			return
+		}
+		if it = get(f, itemFileEnd); it == nil {
+			return
+		}
+		it.random = random
+		if !put(it) {
+			return
+		}
+	}
+}
+
+// Link stage: send each item's commands to the Nano and pass every item
+// on to the checker, in order, once its results (if any) have arrived.
+// If golden isn't nil, each item's commands also go to it, and the item
+// waits for the results of both. If traceRecords isn't zero, the Nano is
+// in trace mode and can hold that many command records. If cover isn't
+// nil, the coverage of each file is added to it. If settle, everything in
+// flight is collected and passed on before an item that clocks the
+// device is sent, so the checker sees every clocked item that might have
+// been applied when the link fails.
+func link(nano *dev.Arduino, golden *dev.Arduino, in <-chan *vectorItem, out chan<- *vectorItem, traceRecords int, cover *runCoverage, settle bool, quit <-chan struct{}) {
+	defer close(out)
+	pipe := dev.NewPipeline(nano, nano.Caps().Window())
+	var goldenPipe *dev.Pipeline
+	if golden != nil {
+		goldenPipe = dev.NewPipeline(golden, golden.Caps().Window())
+	}
+	var pending []*vectorItem // not yet passed on, oldest first
+	traced := 0               // commands recorded by the Nano since the last fetch
+
+	// Collect everything in flight on both links.
+	flush := func() error {
+		err := pipe.Flush()
+		if goldenPipe != nil {
+			if gerr := goldenPipe.Flush(); err == nil {
+				err = gerr
+			}
+		}
+		return err
+	}
+
+	// Collect everything in flight, then fetch the Nano's trace records.
+	// The fetch error, if any, is attached to the item that would have
+	// overflowed the records.
+	fetchTrace := func() error {
+		if err := flush(); err != nil {
+			return err
+		}
+		traced = 0
+		return dev.FetchTrace(nano, nano.Trace())
+	}
+
+	// Pass on the items at the head of pending that are ready. Verify
+	// each checkpoint on the way, and give up after one that fails, so
+	// nothing that clocks the device is sent after it.
+	forward := func() bool {
+		n := 0
+		for ; n < len(pending); n++ {
+			it := pending[n]
+			if !it.done || (goldenPipe != nil && !it.golden.done) {
+				break
+			}
+			confirmed := it.kind != itemCheckpoint || it.confirmCheckpoint(goldenPipe != nil)
+			select {
+			case out <- it:
+			case <-quit:
+				return false
+			}
+			if !confirmed {
+				return false
+			}
+		}
+		pending = pending[:copy(pending, pending[n:])]
+		return true
+	}
+
+	// Give up after err. The items whose commands failed already carry
+	// their errors, but in differential mode the other link may still
+	// owe results for them, or for the items before them, so those are
+	// given err too. Pass on everything.
+	abort := func(err error) {
+		for _, it := range pending {
+			if !it.done {
+				it.complete(nil, err)
+			}
+			if goldenPipe != nil && !it.golden.done {
+				it.golden.complete(nil, err)
+			}
+		}
+		forward()
+	}
+
+	for {
+		var it *vectorItem
+		var ok bool
+		select {
+		case it, ok = <-in:
+		default:
+			// The encoder hasn't kept up. Collect everything
+			// in flight before waiting for it.
+			if err := flush(); err != nil {
+				abort(err)
+				return
+			}
+			if !forward() {
+				return
+			}
+			it, ok = <-in
+		}
+		if !ok {
+			if traceRecords == 0 {
+				flush()
+			} else if err := fetchTrace(); err != nil {
+				log.Printf("fetching trace: %v", err)
+			}
+			forward()
+			return
+		}
+
+		pending = append(pending, it)
+		if it.kind == itemFileEnd && cover != nil {
+			err := flush()
+			if err == nil {
+				err = cover.fetch(nano, it.file.img.socket)
+			}
+			if err != nil {
+				abort(err)
+				return
+			}
+		}
+		if it.commands.Commands() == 0 {
+			// A batched vector's results come with its table's
+			// CmdReplay, which completes it
+			if !it.batched {
+				it.done, it.golden.done = true, true
+			}
+		} else {
+			if settle && it.clocks {
+				if err := flush(); err != nil {
+					abort(err)
+					return
+				}
+				if !forward() {
+					return
+				}
+			}
+			if traceRecords != 0 && traced+it.commands.Commands() > traceRecords {
+				if err := fetchTrace(); err != nil {
+					abort(err)
+					return
+				}
+			}
+			traced += it.commands.Commands()
+			if err := pipe.Submit(it.commands, it); err != nil {
+				abort(err)
+				return
+			}
+			if goldenPipe != nil {
+				if err := goldenPipe.Submit(it.commands, &it.golden); err != nil {
+					abort(fmt.Errorf("golden device: %v", err))
+					return
+				}
+			}
+		}
+		if !forward() {
+			return
+		}
+	}
+}
+
+// Checker stage: check results and report, in order, then recycle
+// the items. Record each checkpoint and the end of each file in
+// progress, and the first vector after it that clocks the device.
+// This runs in the caller's goroutine.
+func checker(in <-chan *vectorItem, free chan<- *vectorItem, differential bool, progress *checkpoint) (int, error) {
+	totalFailures := progress.total
+	for it := range in {
+		f := it.file
+		if differential && it.err == nil && it.golden.err != nil {
+			it.err = fmt.Errorf("golden device: %v", it.golden.err)
+		}
+		switch it.kind {
+		case itemFileStart:
+			if it.err != nil {
+				return totalFailures, linkError{fmt.Errorf("vector file %s: setting the vector layout: %v", f.path, it.err)}
+			}
+			if f.start != 0 {
+				log.Printf("resuming vector file %s after line %d", f.path, it.line)
+			} else {
+				log.Printf("processing vector file %s", f.path)
+			}
+		case itemComment:
+			log.Printf("%s", it.text)
+		case itemVector:
+			if it.clocks && progress.clocked == 0 {
+				progress.clocked = it.line
+			}
+			if it.err != nil {
+				return totalFailures, linkError{fmt.Errorf("vector file %s: line %d: %v", f.path, it.line, it.err)}
+			}
+			check := checkPLCC
+			if it.socket == socketZIF {
+				check = checkZIF
+			}
+			if differential {
+				check = func(line int, c *vectorCheck, results []byte) int {
+					n := len(it.results) - len(results)
+					return diffResults(it, line, c, results, it.golden.results[n:])
+				}
+			}
+			results := it.results[:]
+			if it.phased {
+				results = results[dev.ApplyResults:]
+			}
+			f.failures += check(it.line, &it.check, results)
+			for p := 0; p < it.phases; p++ {
+				results = results[dev.ApplyResults:]
+				f.failures += check(it.phaseLines[p], &it.phaseChecks[p], results)
+			}
+		case itemFlush, itemRestore:
+			if it.err != nil {
+				return totalFailures, linkError{fmt.Errorf("vector file %s: line %d: %v", f.path, it.line, it.err)}
+			}
+		case itemCheckpoint:
+			if it.err != nil {
+				return totalFailures, linkError{fmt.Errorf("vector file %s: checkpoint after line %d: %v", f.path, it.line, it.err)}
+			}
+			progress.record(it, totalFailures)
+		case itemFileEnd:
+			if it.err != nil {
+				return totalFailures, linkError{fmt.Errorf("vector file %s: fetching coverage: %v", f.path, it.err)}
+			}
+			if f.start == 0 {
+				f.stats.report(f.path) // a resumed file's would be partial
+			}
+			log.Printf("vector file %s: %d failure(s)", f.path, f.failures)
+			totalFailures += f.failures
+			*progress = checkpoint{file: f.index + 1, total: totalFailures, random: it.random}
+		case itemError:
+			return totalFailures, fmt.Errorf("vector file %s: %v", f.path, it.err)
+		}
+		free <- it
+	}
+	return totalFailures, nil
+}
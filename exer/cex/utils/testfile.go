@@ -27,10 +27,12 @@ type TestFile struct {
 	socket   string       // "PLCC" or "ZIF"
 	size     int          // number of bits, 0 .. size-1
 	clockPin int          // PIN NUMBER 1..n of clock, or 0
+	clocks   int          // times to pulse the clock
 	nano     *dev.Arduino // open Arduino device
 	toUUT    *FixedBitVec // bits that are UUT inputs
 	fromUUT  *FixedBitVec // bits that are UUT outputs
 	ignored  *FixedBitVec // bits that are read but not checked
+	driven   *FixedBitVec // bits that were given a toUUT value
 }
 
 // Allocate a test file object. The returned value may be defined
@@ -54,6 +56,7 @@ func NewTestFile(socket string, nano *dev.Arduino) *TestFile {
 		toUUT:    NewFixedBitVec(size),
 		fromUUT:  NewFixedBitVec(size),
 		ignored:  NewFixedBitVec(size),
+		driven:   NewFixedBitVec(size),
 	}
 }
 
@@ -71,6 +74,7 @@ func (tf *TestFile) Nano() *dev.Arduino {
 
 func (tf *TestFile) SetToUUT(bit BitPosition) {
 	tf.toUUT.Set(bit)
+	tf.driven.Set(bit)
 }
 
 func (tf *TestFile) SetFromUUT(bit BitPosition) {
@@ -79,6 +83,7 @@ func (tf *TestFile) SetFromUUT(bit BitPosition) {
 
 func (tf *TestFile) ResetToUUT(bit BitPosition) {
 	tf.toUUT.Reset(bit)
+	tf.driven.Set(bit)
 }
 
 func (tf *TestFile) ResetFromUUT(bit BitPosition) {
@@ -93,6 +98,12 @@ func (tf *TestFile) GetFromUUT(bit BitPosition) int {
 	return tf.fromUUT.Get(bit)
 }
 
+// Get a bit that is 1 if the BitPosition is a toUUT pin in this
+// vector, whatever its value. The ZIF socket's pins may be either.
+func (tf *TestFile) IsToUUT(bit BitPosition) int {
+	return tf.driven.Get(bit)
+}
+
 // Set a bit that causes a fromUUT pin to be ignored
 func (tf *TestFile) SetIgnored(bit BitPosition) {
 	tf.ignored.Set(bit)
@@ -113,9 +124,21 @@ func (tf *TestFile) IsIgnored(bit BitPosition) int {
 // we assume a positive edge clock.
 func (tf *TestFile) SetClock(bit BitPosition) {
 	tf.clockPin = 1 + int(bit)
+	tf.clocks = 1
 	tf.SetToUUT(bit)
 }
 
+// Set the number of times to pulse the clock, which is 1 unless
+// this is called after SetClock().
+func (tf *TestFile) SetClockCount(n int) {
+	tf.clocks = n
+}
+
+// Get the number of times to pulse the clock, 0 if there is none.
+func (tf *TestFile) ClockCount() int {
+	return tf.clocks
+}
+
 // Get the clock pin. The result is a position.
 // Panic: no clock pin. Use HasClock() first.
 func (tf *TestFile) GetClock() BitPosition {
@@ -136,9 +159,11 @@ func (tf *TestFile) HasClock() bool {
 // with millions of vectors).
 func (tf *TestFile) Clear() {
 	tf.clockPin = 0 // default none
+	tf.clocks = 0
 	tf.toUUT = NewFixedBitVec(tf.size)
 	tf.fromUUT = NewFixedBitVec(tf.size)
-	tf.clockPin = 0 // "none"
+	tf.ignored = NewFixedBitVec(tf.size)
+	tf.driven = NewFixedBitVec(tf.size)
 }
 
 func (tf *TestFile) GetByteFromUUT(bit BitPosition) byte {
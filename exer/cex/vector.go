@@ -9,13 +9,10 @@ package main
 // "input" and "output" confusing, I usually use "toUUT" and "fromUUT".
 
 import (
-	"bufio"
 	"fmt"
 	"log"
 	"math/bits" // Reverse16
-	"os"
 	"strconv"
-	"strings"
 
 	"cex/dev"
 	"cex/utils"
@@ -23,83 +20,6 @@ import (
 
 const SPACE = ' '
 
-// Process one vector file. The file format and structure
-// are described in the README in this directory. Processing
-// involves parsing the file, applying each vector to the
-// hardware, and reporting the results.
-//
-// TODO track line numbers else troubleshooting bad vectors
-// will be next to impossible.
-func DoVectorFile(filePath string, nano *dev.Arduino) (int, error) {
-	file, err := os.Open(filePath)
-	if err != nil {
-		return 0, err
-	}
-	defer file.Close()
-	return scan(bufio.NewScanner(file), nano)
-}
-
-// Scan one vector file. Return number of hardware failures
-// detected and an error. Hardware failures are not "errors".
-func scan(scanner *bufio.Scanner, nano *dev.Arduino) (int, error) {
-	var tf *utils.TestFile
-	var totalErrors int
-
-	for scanner.Scan() {
-		// First check for empty lines and comments. Lines must
-		// be left-justified. Lines starting with spaces are empty.
-		line := scanner.Text()
-		if len(line) == 0 || line[0] == '#' || line[0] == SPACE {
-			continue
-		}
-
-		// Output log comment
-		if line[0] == '>' {
-			log.Printf("%s", line[1:])
-			continue
-		}
-
-		tokens := strings.Split(line, string(SPACE))
-
-		// Handle the exactly-once-per-file "socket" statement
-		if tokens[0] == "socket" {
-			if tf != nil || len(tokens) != 2 {
-				return 0, fmt.Errorf("bad 'socket' statement")
-			}
-			tf = utils.NewTestFile(tokens[1], nano)
-			if tf == nil {
-				return 0, fmt.Errorf("bad socket type")
-			}
-			continue
-		}
-
-		// Must be a vector or error. We have per-file stuff
-		// and per-vector stuff in the same data structure, the
-		// TestFile. Sort of ugly, meh. Clear the per-vector
-		// fields now.
-		tf.Clear()
-
-		if err := parseVector(tf, tokens); err != nil {
-			return 0, err
-		}
-		if err := scanner.Err(); err != nil {
-			return 0, err
-		}
-		if debug {
-			log.Printf("Parsed: %s\n", tf)
-		}
-
-		// Successfully parsed one vector; apply it
-		errorCount, err := applyVector(tf)
-		if err != nil {
-			return errorCount, err
-		}
-		totalErrors += errorCount
-	}
-
-	return totalErrors, nil
-}
-
 // Parse the next vector from the file into the bit vectors in tf.
 // The tokens should be a line specifying exactly 24 or 68 bits as
 // specified in the socket statement and stored in the size field.
@@ -130,7 +50,15 @@ func parseVector(tf *utils.TestFile, tokens []string) error {
 			tf.SetFromUUT(pos)
 			pos++
 		case 'C':
+			// C pulses the clock once, Cn n times
 			tf.SetClock(pos)
+			if len(t) > 1 {
+				n, err := strconv.Atoi(t[1:])
+				if err != nil || n < 1 || n > 255 {
+					return fmt.Errorf("bad clock count %s", t)
+				}
+				tf.SetClockCount(n)
+			}
 		case 'X', 'G', 'V': // place holders
 			tf.SetIgnored(pos)
 			pos++
@@ -145,6 +73,8 @@ func parseVector(tf *utils.TestFile, tokens []string) error {
 			for i := 0; i < 16; i++ {
 				if v&1 != 0 {
 					tf.SetToUUT(pos)
+				} else {
+					tf.ResetToUUT(pos)
 				}
 				pos++
 				v >>= 1
@@ -175,37 +105,80 @@ func parseVector(tf *utils.TestFile, tokens []string) error {
 	return nil
 }
 
-// Apply the vector stored in the tf structure to the hardware.
+func pinToPos(pin int) utils.BitPosition {
+	return utils.BitPosition(pin - 1)
+}
 
-func applyVector(tf *utils.TestFile) (int, error) {
-	if tf.Socket() == "PLCC" {
-		return applyPLCC(tf)
-	} else if tf.Socket() == "ZIF" {
-		return applyZIF(tf)
-	} else {
-		return 0, fmt.Errorf("unknown socket type %s", tf.Socket())
-	}
+// What is expected of one vector: the expected and mask bytes
+// of its record, and which input registers were read.
+type vectorCheck struct {
+	expect [3]byte
+	mask   [3]byte
+	reads  byte
 }
 
-func pinToPos(pin int) utils.BitPosition {
-	return utils.BitPosition(pin - 1)
+// Check the results of a PLCC vector from the given line of the vector
+// file against what was expected. Log and return the number of failures.
+func checkPLCC(line int, check *vectorCheck, results []byte) int {
+	failures := 0
+
+	// We have the device outputs, whether clocked or combinational,
+	// in cpgzvXXX, bHigh, and bLow. Registers that weren't read have
+	// nothing but X bits, so their (zero) value isn't checked.
+	var cpgzvXXX, bHigh, bLow byte
+	if check.reads&readU11 != 0 {
+		cpgzvXXX, results = results[0], results[1:]
+	}
+	if check.reads&readU3 != 0 {
+		bHigh, results = results[0], results[1:]
+	}
+	if check.reads&readU7 != 0 {
+		bLow = results[0]
+	}
+
+	got := int(bHigh)<<8 | int(bLow)
+	expected := int(check.expect[0])<<8 | int(check.expect[1])
+	mask := int(check.mask[0])<<8 | int(check.mask[1])
+	if (got^expected)&mask != 0 {
+		log.Printf("  line %d: fail expected 0x%04X, got 0x%04X", line, expected, got)
+		failures++
+	}
+
+	names := "CPGZV"
+	flags := check.expect[2]
+	for i := 0; i < len(names); i++ {
+		// Since we don't chain ALU chips to make a 32-bit ALU, we
+		// usually ignore the carry generate and propagate outputs.
+		// Indent the error printf beneath the indented fail line
+		// for the operation, if there was one.
+		if (cpgzvXXX^flags)&check.mask[2]&(1<<i) != 0 {
+			log.Printf("    line %d: fail pin '%c' expected %d", line, names[i], (flags>>i)&1)
+			failures++
+		}
+	}
+	return failures
 }
 
-// Apply one vector, which is stored in the TestFile, to the hardware.
-// Return a count of hardware failures and an error value. Hardware
-// failures do not cause an "error".
-func applyPLCC(tf *utils.TestFile) (int, error) {
+// Indexes of the output registers in the drive bytes of a PLCC
+// record, which are in the order the registers are written.
+const (
+	plccU4 = iota
+	plccU5
+	plccU8
+	plccU10
+	plccU1
+	plccU2
+)
+
+// Compile the PLCC vector stored in the TestFile into r.
+func compilePLCC(tf *utils.TestFile, r *vectorRecord) {
 	var b byte
 
 	// Pins 1 - 8: U4:0..7
-	if err := doSetCmd(fmt.Sprintf("s 4 %02X", tf.GetByteToUUT(0)), tf.Nano()); err != nil {
-		return 0, err
-	}
+	r.drive[plccU4] = tf.GetByteToUUT(0)
 
 	// Pins 9 - 16: U5:0..7
-	if err := doSetCmd(fmt.Sprintf("s 5 %02X", tf.GetByteToUUT(8)), tf.Nano()); err != nil {
-		return 0, err
-	}
+	r.drive[plccU5] = tf.GetByteToUUT(8)
 
 	// Pins 17, 18, 19 - Clk, Vcc, and Gnd
 	// Pins 20..24 Cout, P, G, Z, V outputs from UUT.
@@ -224,9 +197,7 @@ func applyPLCC(tf *utils.TestFile) (int, error) {
 	b |= byte(tf.GetToUUT(pinToPos(46))) << 5 // S1
 	b |= byte(tf.GetToUUT(pinToPos(47))) << 6 // S2
 	b |= byte(tf.GetToUUT(pinToPos(48))) << 7 // OSA
-	if err := doSetCmd(fmt.Sprintf("s 6 %02X", b), tf.Nano()); err != nil {
-		return 0, err
-	}
+	r.drive[plccU8] = b
 
 	// Pins 49 - 52: B10:3..0 (bit reversed)
 	b = 0
@@ -234,9 +205,7 @@ func applyPLCC(tf *utils.TestFile) (int, error) {
 	b |= byte(tf.GetToUUT(pinToPos(50))) << 5 // FTAB
 	b |= byte(tf.GetToUUT(pinToPos(51))) << 6 // ENB#
 	b |= byte(tf.GetToUUT(pinToPos(52))) << 7 // ENA#
-	if err := doSetCmd(fmt.Sprintf("s A %02X", b), tf.Nano()); err != nil {
-		return 0, err
-	}
+	r.drive[plccU10] = b
 
 	// Pins 53 - 60: B1:0..7 (B input low byte)
 	b = 0
@@ -245,9 +214,7 @@ func applyPLCC(tf *utils.TestFile) (int, error) {
 		b |= byte(tf.GetToUUT(i)) << shift
 		shift++
 	}
-	if err := doSetCmd(fmt.Sprintf("s 3 %02X", b), tf.Nano()); err != nil {
-		return 0, err
-	}
+	r.drive[plccU1] = b
 
 	// Pins 61 - 68: B2:0..7 (B input high byte)
 	b = 0
@@ -256,22 +223,142 @@ func applyPLCC(tf *utils.TestFile) (int, error) {
 		b |= byte(tf.GetToUUT(i)) << shift
 		shift++
 	}
-	if err := doSetCmd(fmt.Sprintf("s 2 %02X", b), tf.Nano()); err != nil {
-		return 0, err
+	r.drive[plccU2] = b
+
+	if tf.HasClock() {
+		r.flags |= flagClocked
+		r.clocks = byte(tf.ClockCount())
+	}
+
+	// The F output, pins 28 - 43, is bit reversed, so pin 28 is the
+	// most significant bit. X values are not checked.
+	var f, fMask int
+	shift = 15
+	for i := pinToPos(28); i < pinToPos(44); i++ {
+		f |= (tf.GetFromUUT(i) & 1) << shift
+		fMask |= (1 - tf.IsIgnored(i)) << shift
+		shift--
+	}
+	r.expect[0], r.expect[1] = byte(f>>8), byte(f)
+	r.mask[0], r.mask[1] = byte(fMask>>8), byte(fMask)
+
+	// Pins 20 - 24: carry out (c), carry propagate (p), carry
+	// generate (g), zero flag (z), and overflow flag (v).
+	shift = 0
+	for i := pinToPos(20); i <= pinToPos(24); i++ {
+		r.expect[2] |= byte(tf.GetFromUUT(i)) << shift
+		r.mask[2] |= byte(1-tf.IsIgnored(i)) << shift
+		shift++
+	}
+}
+
+// Indexes of the output registers in the drive bytes of a ZIF record.
+// The last two drive bytes are unused.
+const (
+	zifU1 = iota
+	zifU2
+	zifU8
+	zifU10
+)
+
+// The ZIF pins driven by each of U1, U2, and U8, and the bit of U10
+// (as the host sees it) that is the register's active low output
+// enable. Pin 1 is TSTCLK, which rests high; 'C' pulses it. A pin of
+// the ZIF socket is an input or an output of the device according to
+// the vector, but the exerciser can only turn its pins around eight at
+// a time, so all the pins of a group must agree.
+var zifGroups = [...]struct {
+	first, last int
+	enable      byte
+}{
+	{2, 8, 0x01},   // U1:1..7
+	{9, 16, 0x02},  // U2:0..7
+	{17, 24, 0x04}, // U8:0..7
+}
+
+// U10 when no ZIF pin is driven: all high. The low nibble holds the
+// output enables and the high nibble runs to PLCC control lines, which
+// are held inactive.
+const zifU10Off = 0xFF
+
+// Compile the ZIF vector stored in the TestFile into r. A group of
+// pins is driven by the exerciser if any of its pins is given a value
+// ('0' or '1'). The rest of the pins are captured and checked unless
+// they are X. Return an error if a group mixes inputs and outputs.
+func compileZIF(tf *utils.TestFile, r *vectorRecord) error {
+	r.drive[zifU1] = tf.GetByteToUUT(0)
+	r.drive[zifU2] = tf.GetByteToUUT(8)
+	r.drive[zifU8] = tf.GetByteToUUT(16)
+	r.drive[zifU10] = zifU10Off
+	for _, g := range zifGroups {
+		toUUT, fromUUT := 0, 0
+		for pin := g.first; pin <= g.last; pin++ {
+			if tf.IsToUUT(pinToPos(pin)) != 0 {
+				toUUT++
+			} else if tf.IsIgnored(pinToPos(pin)) == 0 {
+				fromUUT++
+			}
+		}
+		if toUUT != 0 && fromUUT != 0 {
+			return fmt.Errorf("pins %d-%d are driven together, but mix inputs and outputs", g.first, g.last)
+		}
+		if toUUT != 0 {
+			r.drive[zifU10] &^= g.enable
+		}
+	}
+
+	// Pins 1 - 8, 9 - 16, and 17 - 24 are captured by U3, U7, and U11,
+	// in that order in the expected and mask bytes as for the PLCC.
+	// Pins we drive are not checked.
+	for i := 0; i < 3; i++ {
+		pos := utils.BitPosition(8 * i)
+		r.expect[i] = tf.GetByteFromUUT(pos)
+		for j := utils.BitPosition(0); j < 8; j++ {
+			if tf.IsToUUT(pos+j) == 0 && tf.IsIgnored(pos+j) == 0 {
+				r.mask[i] |= 1 << j
+			}
+		}
+	}
+	if tf.HasClock() {
+		r.flags |= flagClocked
+		r.clocks = byte(tf.ClockCount())
+	}
+	return nil
+}
+
+// The output registers in the order of the drive bytes: U4, U5, U8,
+// U10, U1, U2.
+var plccWriteRegs = [...]dev.RegisterID{dev.RegU4Clk, dev.RegU5Clk, dev.RegU8Clk,
+	dev.RegU10Clk, dev.RegU1Clk, dev.RegU2Clk}
+
+// The input registers in the order of the bits of a reads mask:
+// U11, U3, U7. Their clocks and their output enables.
+var plccCaptureRegs = [...]dev.RegisterID{dev.RegU11Clk, dev.RegU3Clk, dev.RegU7Clk}
+var plccReadRegs = [...]dev.RegisterID{dev.RegU11Read, dev.RegU3Read, dev.RegU7Read}
+
+// Encode the commands that apply one compiled vector to the hardware
+// into cb, writing and reading only the registers given by the step of
+// the plan. Return what checkPLCC() should expect of the results.
+func encodePLCC(cb *dev.CommandBuffer, r *vectorRecord, step *vectorStep) vectorCheck {
+	cb.Reset()
+
+	for i, reg := range plccWriteRegs {
+		if step.writes&(1<<i) != 0 {
+			cb.Set(reg, r.drive[i])
+		}
 	}
 
 	// All the static toUUT pins on the PLCC have been set. Now, the
 	// ALU device may be used in a clocked way or combinationally.
 	// If this vector is clocked, toggle PLCC Pin 17, which is wired
 	// to TSTCLK, Nano toggle 8.
-	if tf.HasClock() {
-		doToggleCmd("t 1 8", tf.Nano())
+	if r.clocked() {
+		cb.Pulse(dev.RegTstClk, 1)
 	}
 
 	// Read the chip's outputs through our inputs. We need to clock
-	// each register with a toggle (t) command before we read it with
-	// a get (g) command. The addresses are completely arbitrary. The
-	// first argument to the t command is a count.
+	// each register with a pulse before we read it with a get. The
+	// addresses are completely arbitrary.
 
 	// Pins 20 - 24: U11:0..4: clock bit 0xB, read port 0xC.
 	// Carry out (c), carry propagate (p), carry generate (g), zero
@@ -279,65 +366,217 @@ func applyPLCC(tf *utils.TestFile) (int, error) {
 	// U3/B3: clock pin 0 - high byte of F (result)
 	// U7/B7: clock pin 7 - low byte of F
 
-	if err := doToggleCmd("t 1 B", tf.Nano()); err != nil {
-		return 0, err
+	if step.reads&readU11 != 0 {
+		cb.Pulse(dev.RegU11Clk, 1)
 	}
-	if err := doToggleCmd("t 1 0", tf.Nano()); err != nil {
-		return 0, err
+	if step.reads&readU3 != 0 {
+		cb.Pulse(dev.RegU3Clk, 1)
 	}
-	if err := doToggleCmd("t 1 7", tf.Nano()); err != nil {
-		return 0, err
+	if step.reads&readU7 != 0 {
+		cb.Pulse(dev.RegU7Clk, 1)
 	}
-	cpgzvXXX, err := doGetCmd("g C", tf.Nano())
-	if err != nil {
-		return 0, err
+	if step.reads&readU11 != 0 {
+		cb.Get(dev.RegU11Read)
 	}
-	bHigh, err := doGetCmd("g 1", tf.Nano())
-	if err != nil {
-		return 0, err
+	if step.reads&readU3 != 0 {
+		cb.Get(dev.RegU3Read)
 	}
-	bLow, err := doGetCmd("g 9", tf.Nano())
-	if err != nil {
-		return 0, err
+	if step.reads&readU7 != 0 {
+		cb.Get(dev.RegU7Read)
 	}
 
-	// We have the device outputs, whether clocked or combinational,
-	// in cpgzvXXX, bHigh, and bLow.
+	return vectorCheck{r.expect, r.mask, step.reads}
+}
 
-	errorCount := 0
-	got := int(bHigh) << 8 | int(bLow)
-	expected := 0
-	shift = 15
-	for i := pinToPos(28); i < pinToPos(44); i++ {
-		expected |= (tf.GetFromUUT(i)&1) << shift
-		shift--
+// Encode the layout that lets the Nano apply a PLCC vector with one
+// CmdApply. The write slots are in the order of the drive bytes and
+// the capture and read slots in the order of the reads mask, so both
+// pass through unchanged.
+func encodePLCCLayout(cb *dev.CommandBuffer) {
+	cb.Reset()
+	for i, reg := range plccWriteRegs {
+		cb.Layout(dev.LayoutWrites+i, reg, 0)
 	}
-	if expected != got {
-		log.Printf("  fail expected 0x%04X, got 0x%04X", expected, got)
-		errorCount++
+	cb.Layout(dev.LayoutClock, dev.RegTstClk, 0)
+	for i := range plccCaptureRegs {
+		cb.Layout(dev.LayoutCaptures+i, plccCaptureRegs[i], 0)
+		cb.Layout(dev.LayoutReads+i, plccReadRegs[i], 0)
 	}
+}
 
-	shift = 0
-	names := "CPGZV"
-	for i := pinToPos(20); i <= pinToPos(24); i++ {
-		if (cpgzvXXX>>shift)&1 != byte(tf.GetFromUUT(i)) {
-			// Since we don't chain ALU chips to make a 32-bit ALU, we
-			// usually ignore the carry generate and propagate outputs.
-			// Indent the error printf beneath the indented fail line
-			// for the operation, if there was one.
-			if tf.IsIgnored(i) == 0 {
-				name := names[i - pinToPos(20)]
-				log.Printf("    fail pin '%c' expected %d", name, tf.GetFromUUT(i))
-				errorCount++
-			}
+// Like encodePLCC() but apply the vector with a single CmdApply. The
+// results are packed in the same order, so checkPLCC() takes them as
+// they are. If pipelined, they arrive with the next vector's command.
+// The Nano skips writes of unchanged data itself, which has the same
+// effect as the plan's writes mask, so the mask only matters when it
+// says to write everything.
+func encodePLCCApply(cb *dev.CommandBuffer, r *vectorRecord, step *vectorStep, pipelined bool) vectorCheck {
+	cb.Reset()
+	cb.Apply(plccApplyControl(r, step, pipelined), &r.drive)
+	return vectorCheck{r.expect, r.mask, step.reads}
+}
+
+// Return the control byte of the CmdApply for a PLCC vector.
+func plccApplyControl(r *vectorRecord, step *vectorStep, pipelined bool) byte {
+	ctl := step.reads
+	if step.writes == writeAll {
+		ctl |= dev.ApplyWriteAll
+	}
+	if r.clocked() {
+		ctl |= dev.ApplyClock
+	}
+	if pipelined {
+		ctl |= dev.ApplyPipelined
+	}
+	return ctl
+}
+
+// Encode the command that returns the results of the last pipelined
+// CmdApply.
+func encodeFlush(cb *dev.CommandBuffer) {
+	var none [dev.LayoutNWrites]byte
+	cb.Reset()
+	cb.Apply(dev.ApplyPipelined|dev.ApplyNoWrites, &none)
+}
+
+// The output registers of the drive bytes of a ZIF record. U10 holds
+// the output enables, which the Nano sequences so that the exerciser
+// stops driving a group of pins before the device starts, and the
+// device stops before the exerciser starts.
+var zifWriteRegs = [...]dev.RegisterID{dev.RegU1Clk, dev.RegU2Clk, dev.RegU8Clk, dev.RegU10Clk}
+
+// Encode the layout that lets the Nano apply a ZIF vector with one
+// CmdApply. The input registers are in the same order as for the PLCC,
+// so the reads mask and the packed results mean the same.
+func encodeZIFLayout(cb *dev.CommandBuffer) {
+	cb.Reset()
+	for i := 0; i < dev.LayoutNWrites; i++ {
+		switch {
+		case i == zifU10:
+			cb.Layout(dev.LayoutWrites+i, dev.RegU10Clk, dev.LayoutEnables)
+		case i < len(zifWriteRegs):
+			cb.Layout(dev.LayoutWrites+i, zifWriteRegs[i], 0)
+		default:
+			cb.Layout(dev.LayoutWrites+i, dev.LayoutNone, 0)
 		}
-		shift++
 	}
+	cb.Layout(dev.LayoutClock, dev.RegTstClk, 0)
+	for i := range plccCaptureRegs {
+		cb.Layout(dev.LayoutCaptures+i, plccCaptureRegs[i], 0)
+		cb.Layout(dev.LayoutReads+i, plccReadRegs[i], 0)
+	}
+}
 
-	return errorCount, nil
+// Encode the CmdApply for a ZIF vector. ZIF vectors aren't planned, so
+// this reads only the input registers that capture a checked pin. The
+// Nano skips writes of unchanged data, including the output enables.
+func encodeZIFApply(cb *dev.CommandBuffer, r *vectorRecord, pipelined bool) vectorCheck {
+	cb.Reset()
+	reads := maskReads(r)
+	cb.Apply(zifApplyControl(r, pipelined), &r.drive)
+	return vectorCheck{r.expect, r.mask, reads}
 }
 
-func applyZIF(tf *utils.TestFile) (int, error) {
-	log.Println("applyZIF()")
-	return 0, nil
+// Return the control byte of the CmdApply for a ZIF vector.
+func zifApplyControl(r *vectorRecord, pipelined bool) byte {
+	ctl := maskReads(r)
+	if r.clocked() {
+		ctl |= dev.ApplyClock
+	}
+	if pipelined {
+		ctl |= dev.ApplyPipelined
+	}
+	return ctl
+}
+
+// Return the input registers that capture a checked pin of r.
+func maskReads(r *vectorRecord) byte {
+	var reads byte
+	if r.mask[2] != 0 {
+		reads |= readU11
+	}
+	if r.mask[0] != 0 {
+		reads |= readU3
+	}
+	if r.mask[1] != 0 {
+		reads |= readU7
+	}
+	return reads
+}
+
+// Encode the commands for the vector r, which is step i of plan, if it
+// has more than one clock pulse or clock phases follow it: a CmdApply
+// that writes its inputs, and a CmdClocks that pulses TSTCLK and
+// captures the outputs for the vector and then for each of its phases.
+// Store the checks of the phases in it and return the vector's own. If
+// differential, every output of each phase is read and checked.
+func encodeClockPhases(it *vectorItem, img *vectorImage, plan []vectorStep, i int, r *vectorRecord, differential bool) vectorCheck {
+	cb := it.commands
+	cb.Reset()
+	step := &plan[i]
+	var ctl byte
+	reads := maskReads(r)
+	if img.socket == socketPLCC {
+		reads = step.reads
+		if step.writes == writeAll {
+			ctl |= dev.ApplyWriteAll
+		}
+	}
+	cb.Apply(ctl, &r.drive)
+
+	var phases [dev.ClockPhases]dev.ClockPhase
+	phases[0] = dev.ClockPhase{ID: dev.RegTstClk, Count: r.clocks, Reads: reads}
+	n := 1
+	var p vectorRecord
+	for ; n < dev.ClockPhases && i+n < len(plan); n++ {
+		img.Record(plan[i+n].record, &p)
+		if p.kind != recordPhase {
+			break
+		}
+		if differential {
+			p.mask = outputMask(img.socket, &p)
+		}
+		phases[n] = dev.ClockPhase{ID: dev.RegTstClk, Count: p.clocks, Reads: maskReads(&p)}
+		it.phaseLines[n-1] = p.line
+		it.phaseChecks[n-1] = vectorCheck{p.expect, p.mask, phases[n].Reads}
+	}
+	it.phases = n - 1
+	cb.Clocks(phases[:n])
+	return vectorCheck{r.expect, r.mask, reads}
+}
+
+// Return the captures of U3, U7, and U11, in the order of the expected
+// and mask bytes of a record, from the results of the registers in
+// reads, which are packed in the order U11, U3, U7. Registers that
+// weren't read are zero. For the ZIF, these are pins 1 - 8, 9 - 16, and
+// 17 - 24.
+func captures(reads byte, results []byte) [3]byte {
+	var got [3]byte
+	if reads&readU11 != 0 {
+		got[2], results = results[0], results[1:]
+	}
+	if reads&readU3 != 0 {
+		got[0], results = results[0], results[1:]
+	}
+	if reads&readU7 != 0 {
+		got[1] = results[0]
+	}
+	return got
+}
+
+// Check the results of a ZIF vector from the given line of the vector
+// file. Log each pin that failed and return the number of them.
+func checkZIF(line int, check *vectorCheck, results []byte) int {
+	got := captures(check.reads, results)
+	failures := 0
+	for i := range got {
+		bad := (got[i] ^ check.expect[i]) & check.mask[i]
+		for j := 0; j < 8; j++ {
+			if bad&(1<<j) != 0 {
+				log.Printf("  line %d: fail pin %d expected %d", line, 8*i+j+1, (check.expect[i]>>j)&1)
+				failures++
+			}
+		}
+	}
+	return failures
 }
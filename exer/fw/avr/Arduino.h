@@ -0,0 +1,61 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+//
+// Just enough of the Arduino environment to build the firmware with
+// avr-gcc alone, without the Arduino core. The I/O registers, interrupt
+// macros, and program memory functions are avr-libc's own; the rest is
+// a minimal runtime in runtime.cpp: a millisecond tick on Timer0 and an
+// interrupt driven USART, both sized and timed like the core's so the
+// firmware behaves the same on either build.
+//
+// Nothing here is part of the firmware proper, which must still build
+// unchanged in the Arduino IDE.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+typedef uint8_t byte;
+
+#define OUTPUT 1
+#define INPUT 0
+#define HIGH 1
+#define LOW 0
+
+// Digital pins are numbered as on the Nano: 0..7 are PORTD, 8..13 are
+// PORTB, and 14..19 (A0..A5) are PORTC.
+void pinMode(byte pin, byte mode);
+void digitalWrite(byte pin, byte value);
+
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+unsigned long millis();
+unsigned long micros();
+
+// The USB serial port, which is USART0 through the Nano's USB bridge.
+// The receive buffer is the size of the Arduino core's, which the
+// firmware reports to the host; bytes that arrive when it's full are
+// lost. A write waits if the transmit buffer is full.
+#define SERIAL_RX_BUFFER_SIZE 64
+#define SERIAL_TX_BUFFER_SIZE 64
+
+class AvrSerial {
+ public:
+  void begin(long baud);
+  operator bool() const { return true; }
+  int available();
+  int read();
+  int availableForWrite();
+  size_t write(uint8_t b);
+};
+
+extern AvrSerial Serial;
+
+// The sketch
+void setup();
+void loop();
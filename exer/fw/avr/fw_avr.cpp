@@ -0,0 +1,8 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+//
+// The firmware, built with avr-gcc and the minimal runtime instead of
+// the Arduino core. The Arduino IDE includes Arduino.h implicitly; here
+// it's the runtime's version.
+
+#include "Arduino.h"
+#include "../fw.ino"
@@ -0,0 +1,202 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+//
+// The minimal runtime for the avr-gcc build of the firmware: main(), a
+// millisecond tick, delays, the LED pin, and the serial port. See
+// Arduino.h. Timer1 is left alone; it's the firmware's time base.
+
+#include "Arduino.h"
+
+namespace {
+  // === Tick ===
+
+  // Timer0 runs at clk/64, 4us per count, and clears itself after 250
+  // counts, so it interrupts exactly once a millisecond. (The Arduino
+  // core lets it overflow every 1.024ms and corrects millis() as it goes.)
+  constexpr byte TICK_COUNTS = 250;
+  constexpr byte MICROS_PER_COUNT = 4;
+
+  volatile unsigned long tickMillis;
+
+  void tickInit() {
+    TCCR0A = _BV(WGM01);                // CTC mode
+    TCCR0B = _BV(CS01) | _BV(CS00);     // clk/64
+    OCR0A = TICK_COUNTS - 1;
+    TIMSK0 = _BV(OCIE0A);
+  }
+
+  // === Serial ===
+
+  constexpr byte RX_SIZE = SERIAL_RX_BUFFER_SIZE;
+  constexpr byte TX_SIZE = SERIAL_TX_BUFFER_SIZE;
+
+  volatile byte rxBuf[RX_SIZE];
+  volatile byte rxHead; // Added by the ISR
+  volatile byte rxTail;
+
+  volatile byte txBuf[TX_SIZE];
+  volatile byte txHead;
+  volatile byte txTail; // Removed by the ISR
+
+  // Move the next byte of the transmit buffer to the USART, and stop
+  // the data register empty interrupt if it was the last. Called with
+  // interrupts masked.
+  void txSendNext() {
+    UDR0 = txBuf[txTail];
+    txTail = (txTail + 1) % TX_SIZE;
+    if (txHead == txTail) {
+      UCSR0B &= ~_BV(UDRIE0);
+    }
+  }
+}
+
+ISR(TIMER0_COMPA_vect) {
+  tickMillis++;
+}
+
+ISR(USART_RX_vect) {
+  byte c = UDR0;
+  byte next = (rxHead + 1) % RX_SIZE;
+  if (next != rxTail) {
+    rxBuf[rxHead] = c;
+    rxHead = next;
+  }
+}
+
+ISR(USART_UDRE_vect) {
+  txSendNext();
+}
+
+unsigned long millis() {
+  byte sreg = SREG;
+  cli();
+  unsigned long ms = tickMillis;
+  SREG = sreg;
+  return ms;
+}
+
+unsigned long micros() {
+  byte sreg = SREG;
+  cli();
+  unsigned long ms = tickMillis;
+  byte counts = TCNT0;
+  // If the timer has cleared since interrupts were masked, its tick
+  // hasn't been counted yet.
+  if ((TIFR0 & _BV(OCF0A)) && counts < TICK_COUNTS / 2) {
+    ms++;
+  }
+  SREG = sreg;
+  return ms * 1000 + counts * MICROS_PER_COUNT;
+}
+
+void delay(unsigned long ms) {
+  unsigned long start = micros();
+  while (ms > 0) {
+    if (micros() - start >= 1000) {
+      ms--;
+      start += 1000;
+    }
+  }
+}
+
+// Each iteration of the loop is 4 cycles, a quarter microsecond at
+// 16MHz, and the call and setup take about another microsecond. This
+// must not be inlined, or LTO could change the overhead it allows for.
+__attribute__((noinline)) void delayMicroseconds(unsigned int us) {
+  if (us <= 1) {
+    return;
+  }
+  us = (us << 2) - 5;
+  __asm__ __volatile__ (
+    "1: sbiw %0,1" "\n\t"
+    "brne 1b" : "=w" (us) : "0" (us)
+  );
+}
+
+// Only the pins of PORTB and PORTC are used this way; the firmware
+// drives the others through the port registers.
+void pinMode(byte pin, byte mode) {
+  volatile uint8_t* ddr = (pin < 8) ? &DDRD : (pin < 14) ? &DDRB : &DDRC;
+  byte bit = _BV((pin < 8) ? pin : (pin < 14) ? pin - 8 : pin - 14);
+  byte sreg = SREG;
+  cli();
+  if (mode == OUTPUT) {
+    *ddr |= bit;
+  } else {
+    *ddr &= ~bit;
+  }
+  SREG = sreg;
+}
+
+void digitalWrite(byte pin, byte value) {
+  volatile uint8_t* port = (pin < 8) ? &PORTD : (pin < 14) ? &PORTB : &PORTC;
+  byte bit = _BV((pin < 8) ? pin : (pin < 14) ? pin - 8 : pin - 14);
+  byte sreg = SREG;
+  cli();
+  if (value == LOW) {
+    *port &= ~bit;
+  } else {
+    *port |= bit;
+  }
+  SREG = sreg;
+}
+
+AvrSerial Serial;
+
+// 8N1 at double speed, as the core does it. At 115200 baud the
+// nearest divisor is 2.1% fast, well within what the USB bridge takes.
+void AvrSerial::begin(long baud) {
+  UCSR0A = _BV(U2X0);
+  UBRR0 = ((F_CPU / 4 / baud) - 1) / 2;
+  UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+  UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);
+}
+
+int AvrSerial::available() {
+  return (RX_SIZE + rxHead - rxTail) % RX_SIZE;
+}
+
+int AvrSerial::read() {
+  if (rxHead == rxTail) {
+    return -1;
+  }
+  byte c = rxBuf[rxTail];
+  rxTail = (rxTail + 1) % RX_SIZE;
+  return c;
+}
+
+int AvrSerial::availableForWrite() {
+  byte head = txHead;
+  byte tail = txTail;
+  return (TX_SIZE - 1 + tail - head) % TX_SIZE;
+}
+
+size_t AvrSerial::write(uint8_t b) {
+  // If nothing is waiting, the byte can go straight to the USART.
+  if (txHead == txTail && (UCSR0A & _BV(UDRE0))) {
+    UDR0 = b;
+    return 1;
+  }
+  byte next = (txHead + 1) % TX_SIZE;
+  while (next == txTail) {
+    // Full. The ISR empties it, unless interrupts are masked.
+    if (!(SREG & _BV(SREG_I)) && (UCSR0A & _BV(UDRE0))) {
+      txSendNext();
+    }
+  }
+  txBuf[txHead] = b;
+  byte sreg = SREG;
+  cli();
+  txHead = next;
+  UCSR0B |= _BV(UDRIE0);
+  SREG = sreg;
+  return 1;
+}
+
+int main() {
+  tickInit();
+  sei();
+  setup();
+  for (;;) {
+    loop();
+  }
+}
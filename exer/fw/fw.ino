@@ -28,11 +28,11 @@
 //
 // There is a tiny "task executor" for the "tasks". But don't be fooled;
 // the task abstraction is just a way of structuring the main loop.
-// There are no trixie preemption schemes, no interrupt code, nothing
-// like that. Just a main loop that runs through all the task bodies
-// as quickly as possible. In fact, "tasks" don't need to have bodies
-// or even init functions; the logging "task" is just a couple of public
-// functions and some private data.
+// There are no trixie preemption schemes, no interrupt code except the
+// time base's timer overflow, nothing like that. Just a main loop that
+// runs through all the task bodies as quickly as possible. In fact,
+// "tasks" don't need to have bodies or even init functions; the logging
+// "task" is just a couple of public functions and some private data.
 //
 // We do concede to including the task runner last so we don't have
 // to forward-declare all the task init and body functions. We could
@@ -18,6 +18,7 @@ namespace PortPrivate {
 
   void callWhenAnyReset(void);      // Called from the top of postInit() always
   void callAfterPostInit(void);     // Called from the end of postInit() always
+  int costTask(void);               // Continuous self test, called from portTask()
   
   // Because of the order of initialization, this is basically
   // the very first code executed on either a hard or soft reset.
@@ -78,7 +79,7 @@ void portInit() {
 }
 
 int portTask() {
-  return 171;
+  return PortPrivate::costTask();
 }
 
 bool postInit() {
@@ -101,17 +102,93 @@ namespace PortPrivate {
   }
 
   void callAfterPostInit() {
-    // Three output enables in the chip exerciser (output enables of U2, U3,
+    // Three output enables in the chip exerciser (output enables of U1, U2,
     // and U8) are controlled by setting bits low in the exerciser's output
-    // register U10. This is intended to allow some of pins on the ZIF socket
-    // to conditionally become inputs to the chip under test, but it's not
-    // fully implemented. So for now we always want these bits low to enable
-    // the outputs of U2, U3, and U8. The nanoSetRegister() function does
-    // this, but it needs to be called once to ensure the pins get set. The
-    // other bits of U10 (B10) run to some control lines on the PLCC-68 that
-    // are active low, so we force them high.
+    // register U10. This allows the pins of the ZIF socket they drive to
+    // become outputs of the chip under test. Until a vector says which pins
+    // the chip drives, we want these bits high so the registers can't fight
+    // it. A set of U10 makes them low again (see stSet()), as the PLCC needs.
+    // The other bits of U10 (B10) run to some control lines on the PLCC-68
+    // that are active low, so we force them high too.
     nanoSetRegister(RI_U10_CLK, 0xFF);
   }
 }
 
+// Continuous self test (COST). When the host has sent no hardware command
+// for a while, the port task checks the exerciser's read paths in the
+// background, one register read per call, so it costs nothing while
+// vectors are being applied. An input register holds what it captured
+// until it's clocked again, and only a hardware command can clock one,
+// so each read in an idle period must return what the first one did.
+// A read that doesn't points to a latch that's losing its contents, a
+// decoder or output enable that's failing, or contention on the I/O bus
+// -- faults that would otherwise show up only as mysterious vector
+// failures. Reads don't disturb the device in the sockets or anything
+// the host is waiting for, including the results of a pipelined apply.
+//
+// A failure is logged, not a panic, with code PANIC_COST | test, where
+// test is the index of the input register in costInputs.
+namespace PortPrivate {
+
+  constexpr unsigned long COST_IDLE_MILLIS = 211;  // idle if no hardware command this long
+  constexpr int COST_INTERVAL_MILLIS = 53;         // between reads while idle
+  constexpr int COST_BUSY_MILLIS = 97;             // between idle checks otherwise
+
+  const PROGMEM REGISTER_ID costInputs[] = { RI_B3_OE, RI_B7_OE, RI_U11_OE };
+  constexpr byte COST_N_INPUTS = sizeof(costInputs) / sizeof(costInputs[0]);
+
+  byte costHeld[COST_N_INPUTS];  // the first value read in this idle period
+  byte costValid;                // bit i set if costHeld[i] is valid
+  byte costReported;             // bit i set if register i failed in this period
+  unsigned long costPeriod;      // serialHardwareMillis() when the period began
+  byte costNext;                 // index of the next register to read
+
+  // The failure being reported, for the log callback
+  byte costTest;
+  byte costExpected;
+  byte costActual;
+  unsigned int costFailures;     // since reset
+  bool costReportQueued;
+
+  int costMessageCallback(char *bp, int bmax) {
+    costReportQueued = false;
+    int n = snprintf_P(bp, bmax, PSTR("COST 0x%02X: register %d read 0x%02X, held 0x%02X (%u failures)"),
+                       PANIC_COST | costTest, pgm_read_byte_near(&costInputs[costTest]),
+                       costActual, costExpected, costFailures);
+    return (n > bmax) ? bmax : n;
+  }
+
+  int costTask() {
+    unsigned long period = serialHardwareMillis();
+    if (millis() - period < COST_IDLE_MILLIS || serialIsBusy()) {
+      return COST_BUSY_MILLIS;
+    }
+    if (period != costPeriod) {
+      costPeriod = period;
+      costValid = 0;
+      costReported = 0;
+    }
+
+    byte i = costNext;
+    costNext = (costNext + 1) % COST_N_INPUTS;
+    byte value = nanoGetRegister(pgm_read_byte_near(&costInputs[i]));
+    if (!(costValid & (1 << i))) {
+      costHeld[i] = value;
+      costValid |= (1 << i);
+    } else if (value != costHeld[i]) {
+      // Log the first failure of each register in a period, so a
+      // failing path can't flood the log.
+      costFailures++;
+      if (!(costReported & (1 << i)) && !costReportQueued) {
+        costTest = i;
+        costExpected = costHeld[i];
+        costActual = value;
+        costReported |= (1 << i);
+        costReportQueued = logQueueCallback(costMessageCallback);
+      }
+    }
+    return COST_INTERVAL_MILLIS;
+  }
+}
+
 
@@ -251,11 +251,22 @@ byte nanoGetPort(PinList port) {
   return byte(portDbits | portBbits);
 }
 
+// The direction of the data port, or NOT_SET before it's first set.
+constexpr int NOT_SET = -1;
+int dataPortMode = NOT_SET;
+
 // Set the data port to be output or input. Delays in this file are
 // critical and must not be altered; some of them handle documented
 // issues with the ATmega, and some handle registrictions imposed by
 // the design of the external registers. This one is the first kind.
+// Setting the port to the direction it already has changes nothing
+// that would need the delay, so it's skipped. Then a run of sets costs
+// no delay at all and a run of reads (nanoReadRegister()) costs one.
 void nanoSetDataPortMode(int mode) {
+    if (mode == dataPortMode) {
+      return;
+    }
+    dataPortMode = mode;
     if (mode == OUTPUT) {
       DDRD = DDRD | 0xE0;
       DDRB = DDRB | 0x1F;
@@ -281,6 +292,29 @@ void nanoSetMode(PinList port, int mode) {
   }
 }
 
+// Deterministic timing. An interrupt that arrives during a bus
+// transaction, Timer0's for millis() or the USART's, stretches it by
+// the length of the ISR, several microseconds. So the delays in this
+// file have to allow for it, and the timing of the decoder pulses and
+// read windows varies. When nanoAtomicBus is true, each transaction
+// runs with interrupts masked, and a pending ISR runs after it. At
+// 115200 baud a byte takes 87us, so the USART can't lose one to the
+// few microseconds of a transaction.
+bool nanoAtomicBus = false;
+
+// Begin a bus transaction. Return the SREG to restore at its end.
+byte nanoBusBegin() {
+  byte sreg = SREG;
+  if (nanoAtomicBus) {
+    cli();
+  }
+  return sreg;
+}
+
+void nanoBusEnd(byte sreg) {
+  SREG = sreg;
+}
+
 // This is a critical function that serves to pulse one of the 16
 // decoder outputs. To do this, it has to put the 3-bit address of
 // one of 8 data ports on to the 3-bit select port which is bussed
@@ -291,6 +325,7 @@ void nanoTogglePulse(REGISTER_ID reg) {
   // Bug fix (although no symptoms were ever seen): to prevent glitches
   // and overlap on busses, we must disable both decoders before enabling
   // either one.
+  byte sreg = nanoBusBegin();
   PORTC &= ~BOTH_DECODERS;
   
   byte decoderAddress = getAddressFromRegisterID(reg);
@@ -299,6 +334,7 @@ void nanoTogglePulse(REGISTER_ID reg) {
   byte decoderEnablePin = getDecoderSelectPinFromRegisterID(reg);
   PORTC = PORTC | decoderEnablePin;
   PORTC = PORTC & ~decoderEnablePin;
+  nanoBusEnd(sreg);
 }
 
 #if 0 
@@ -320,40 +356,104 @@ void nanoStartToggle(REGISTER_ID reg) {
 // read the value after setting the enable line low and before setting
 // it high again. As always, the delays are the result of careful
 // experimentation and are absolutely required.
-byte nanoGetRegister(REGISTER_ID reg) {    
+//
+// The data port must already be an input. The caller must set it back
+// to output after the last of a run of reads, because the bus must not
+// be left floating.
+byte nanoReadRegister(REGISTER_ID reg) {
+  byte sreg = nanoBusBegin();
   byte decoderAddress = getAddressFromRegisterID(reg);
   nanoPutPort(portSelect, decoderAddress);
-  
-  nanoSetMode(portData, INPUT);
-  
+
   byte result;
   byte decoderEnablePin = getDecoderSelectPinFromRegisterID(reg);
   PORTC |= decoderEnablePin;
   delayMicroseconds(2);
   result = nanoGetPort(portData);
   PORTC &= ~decoderEnablePin;
-  
+  nanoBusEnd(sreg);
+  return result;
+}
+
+byte nanoGetRegister(REGISTER_ID reg) {    
+  nanoSetMode(portData, INPUT);
+  byte result = nanoReadRegister(reg);
   nanoSetMode(portData, OUTPUT);
   return result;
 }
 
 void nanoSetRegister(REGISTER_ID reg, byte data) {
-  // The low order 4 bits of U10 must always stay low for now, because they
-  // are output enables for other output registers. Setting them high would
-  // make it possible to share some test lines as either inputs or outputs.
-  // This would require additional hardware that is in the design but is not
-  // implemented.
-  if (reg == RI_U10_CLK) {
-    data &= 0xF0;
-  }
-
   // Some ports are bit reversed as a wiring convenience.
   if (reg == RI_U10_CLK) {
     data = reverse_byte(data);
   }
 
+  byte sreg = nanoBusBegin();
   nanoSetMode(portData, OUTPUT);
   nanoPutPort(portData, data);    
   nanoTogglePulse(reg);
+  nanoBusEnd(sreg);
 }
 
+// Jitter measurement. Time each bus primitive reps times in CPU cycles
+// with Timer1, borrowed from the time base and run undivided, and store
+// the least and most cycles of each in jitter. The time base is started
+// again afterwards from where it would be, by micros(). The empty
+// measurement is the cost of timing nothing, which the others include.
+// The primitives use the decoder outputs with no connection, and input
+// register U3, so nothing outside the Nano changes.
+
+enum {
+  JITTER_EMPTY_PRIMITIVE,
+  JITTER_PULSE_PRIMITIVE,
+  JITTER_SET_PRIMITIVE,
+  JITTER_READ_PRIMITIVE,
+  JITTER_N_PRIMITIVES,
+};
+
+constexpr REGISTER_ID RI_UN_HI_6 = DECODER_SELECT_MASK|UN_HI_6;
+constexpr REGISTER_ID RI_UN_HI_7 = DECODER_SELECT_MASK|UN_HI_7;
+
+typedef struct jitterRange {
+  unsigned int least;
+  unsigned int most;
+} JitterRange;
+
+void nanoMeasureJitter(JitterRange* jitter, unsigned int reps) {
+  unsigned long began = micros();
+  Ticks now = timeStop();
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+
+  for (byte p = 0; p < JITTER_N_PRIMITIVES; ++p) {
+    jitter[p].least = 0xFFFF;
+    jitter[p].most = 0;
+    if (p == JITTER_READ_PRIMITIVE) {
+      nanoSetMode(portData, INPUT);
+    }
+    for (unsigned int i = 0; i < reps; ++i) {
+      unsigned int start = TCNT1;
+      switch (p) {
+      case JITTER_PULSE_PRIMITIVE:
+        nanoTogglePulse(RI_UN_HI_7);
+        break;
+      case JITTER_SET_PRIMITIVE:
+        nanoSetRegister(RI_UN_HI_6, byte(i));
+        break;
+      case JITTER_READ_PRIMITIVE:
+        nanoReadRegister(RI_B3_OE);
+        break;
+      }
+      unsigned int cycles = TCNT1 - start;
+      if (cycles < jitter[p].least) {
+        jitter[p].least = cycles;
+      }
+      if (cycles > jitter[p].most) {
+        jitter[p].most = cycles;
+      }
+    }
+  }
+  nanoSetMode(portData, OUTPUT);
+
+  timeStart(now + (micros() - began) * TICKS_PER_MICRO);
+}
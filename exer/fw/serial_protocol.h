@@ -1,13 +1,26 @@
 // Copyright (c) Jeff Berkowitz 2021, 2023. All Rights Reserved
 // This must be kept in sync with serial_protocol.h in the Go code
 
-#define PROTOCOL_VERSION 13
+#define PROTOCOL_VERSION 23
+#define PROTOCOL_MIN_VERSION 13  // oldest firmware the host still accepts
 #define ACK(CMD) ((byte)~CMD)
 
 #define STCMD_BASE      0xE0
 #define STCMD_SYNC      0xE1
 #define STCMD_GET_VER   0xE2
 #define STCMD_POLL      0xE3
+#define STCMD_GET_CAPS  0xE4  // counted response, see below
+#define STCMD_TRACE     0xE5  // on/off; response is number of trace records
+#define STCMD_GET_TRACE 0xE6  // counted response, see below
+#define STCMD_COVERAGE  0xE7  // flags; counted response, see below
+#define STCMD_LAYOUT    0xE8  // slot id, see below
+#define STCMD_APPLY     0xE9  // ctl d0..d5; response is APPLY_RESULTS bytes
+#define STCMD_CLOCKS    0xEA  // (ctl count) x CLOCK_PHASES; response is CLOCK_RESULTS bytes
+#define STCMD_TIMING    0xEB  // flags, see below
+#define STCMD_JITTER    0xEC  // reps / JITTER_REPS_UNIT; counted response, see below
+#define STCMD_LOAD      0xED  // count, then count bytes of vector stream, see below
+#define STCMD_REPLAY    0xEE  // count; response is count bytes, see below
+#define STCMD_CHECKPOINT 0xEF // response is CHECKPOINT_SIZE bytes, see below
 
 #define STCMD_PULSE     0xF0
 #define STCMD_SET       0xF4
@@ -16,3 +29,176 @@
 #define STCMD_GETR      0xF9  // bit-reversed get
 
 #define STERR_BADCMD    0x81  // bad command byte
+
+// Capability bits returned by STCMD_GET_CAPS. The host must not use
+// an optional feature unless the firmware reports the capability.
+#define CAP_PIPELINE    0x0001  // acks are in order; host may write ahead
+#define CAP_TRACE       0x0002  // STCMD_TRACE and STCMD_GET_TRACE
+#define CAP_APPLY       0x0004  // STCMD_LAYOUT and STCMD_APPLY
+#define CAP_ENABLES     0x0008  // LAYOUT_ENABLES
+#define CAP_LOG_FRAMES  0x0010  // poll responses are frames, see below
+#define CAP_COVERAGE    0x0020  // STCMD_COVERAGE
+#define CAP_CLOCKS      0x0040  // STCMD_CLOCKS
+#define CAP_TIMING      0x0080  // STCMD_TIMING and STCMD_JITTER
+#define CAP_REPLAY      0x0100  // STCMD_LOAD and STCMD_REPLAY
+#define CAP_CHECKPOINT  0x0200  // STCMD_CHECKPOINT
+
+// Offsets in the counted response of STCMD_GET_CAPS. All values are
+// bytes except the 16-bit capability bits and baud rate / 100, which
+// are little endian.
+#define CAPS_VERSION        0
+#define CAPS_BITS           1   // 2 bytes
+#define CAPS_RCV_RING       3   // receive ring size
+#define CAPS_RX_BUFFER      4   // Arduino core receive buffer size
+#define CAPS_MAX_CMD        5   // largest fixed command
+#define CAPS_MAX_PAYLOAD    6   // largest counted response
+#define CAPS_BAUD           7   // 2 bytes, baud rate / 100
+#define CAPS_SIZE           9
+
+// The counted response of STCMD_GET_TRACE is a header followed by
+// trace records, oldest first. Times are micros() on the Nano. The
+// three later times in a record are 16-bit deltas from the receive
+// time, saturated at 0xFFFF. Multibyte values are little endian.
+#define TRACE_HDR_NOW       0   // 4 bytes, micros() when the response was built
+#define TRACE_HDR_DROPPED   4   // records dropped because the buffer was full
+#define TRACE_HDR_SIZE      5
+
+#define TRACE_REC_CMD       0   // command byte
+#define TRACE_REC_RECEIVED  1   // 4 bytes, command first seen by process()
+#define TRACE_REC_DISPATCH  5   // 2 bytes, command complete; handler called
+#define TRACE_REC_DONE      7   // 2 bytes, handler returned
+#define TRACE_REC_XMIT      9   // 2 bytes, last response byte to Serial
+#define TRACE_REC_SIZE      11
+
+// The counted response of STCMD_COVERAGE is two bitmaps indexed by
+// register ID: the bits written to or read from each register as one,
+// and as zero, since the bitmaps were cleared. They're cleared when the
+// session is created and after the response if COVER_CLEAR is set.
+#define COVER_ONES          0   // 16 bytes
+#define COVER_ZEROS         16  // 16 bytes
+#define COVER_SIZE          32
+#define COVER_CLEAR         0x01
+
+// A log message is returned by STCMD_POLL in frames of at most
+// LOG_FRAME_SIZE bytes, one per poll. LOG_MORE is set in the count of
+// every frame but the last. A count of zero ends any message that was
+// in progress; the rest of that message is lost.
+#define LOG_FRAME_SIZE      32
+#define LOG_MORE            0x80
+#define LOG_COUNT           0x7F
+
+// STCMD_APPLY applies one vector in one command, using a layout of
+// register IDs set beforehand by STCMD_LAYOUT, one slot at a time. The
+// ID in a slot may have LAYOUT_REVERSED set to bit reverse the data,
+// or be LAYOUT_NONE. Data byte i of STCMD_APPLY goes to write slot i.
+// Capture slot i and read slot i are the clock and output enable of the
+// same input register, selected by bit i of APPLY_READS. The results of
+// the registers read are returned in slot order, packed at the start of
+// the response; the rest of the response is zero.
+//
+// A write slot whose ID has LAYOUT_ENABLES holds active low output
+// enables, e.g. those of the registers that drive the ZIF socket. It is
+// written twice: before the other writes, turning off every driver that
+// is off in either the old or the new data, and after them, turning on
+// the drivers that are on in the new data. So the device and the board
+// never drive a pin at the same time while the pin changes direction,
+// provided the device's own output enables are among the other writes.
+#define LAYOUT_WRITES       0   // slots 0..5, output registers
+#define LAYOUT_N_WRITES     6
+#define LAYOUT_CLOCK        6   // pulsed after the writes if APPLY_CLOCK
+#define LAYOUT_CAPTURES     7   // slots 7..9, input register clocks
+#define LAYOUT_READS        10  // slots 10..12, input register enables
+#define LAYOUT_N_READS      3
+#define LAYOUT_SLOTS        13
+#define LAYOUT_ID           0x0F  // the register ID
+#define LAYOUT_REVERSED     0x10
+#define LAYOUT_ENABLES      0x20
+#define LAYOUT_NONE         0xFF
+
+// STCMD_APPLY control bits. Writes of data unchanged since the last
+// STCMD_APPLY are skipped unless APPLY_WRITE_ALL is set. In pipelined
+// mode, the response holds the results of the previous STCMD_APPLY,
+// which are still held in the input registers and are read before this
+// vector's writes. Its own results come back with the next STCMD_APPLY.
+// One with APPLY_NO_WRITES and no clock or reads flushes them.
+#define APPLY_READS         0x07  // capture and read these input registers
+#define APPLY_CLOCK         0x08
+#define APPLY_PIPELINED     0x10
+#define APPLY_WRITE_ALL     0x20
+#define APPLY_NO_WRITES     0x40
+#define APPLY_RESULTS       LAYOUT_N_READS
+
+// STCMD_CLOCKS runs up to CLOCK_PHASES clock phases of a vector whose
+// inputs have been written, e.g. by an STCMD_APPLY without a clock or
+// reads. Each phase is a control byte and a count. The register with
+// the ID in CLOCK_ID is pulsed count times, and then the input registers
+// in CLOCK_READS (as in APPLY_READS) are captured and read, using the
+// layout. The results of phase i are packed in slot order at byte
+// i * APPLY_RESULTS of the response. Unused phases are zero. Results of
+// a pipelined STCMD_APPLY must be flushed first.
+#define CLOCK_PHASES        3
+#define CLOCK_ID            0x0F
+#define CLOCK_READS         0x70
+#define CLOCK_READS_SHIFT   4
+#define CLOCK_RESULTS       (CLOCK_PHASES * APPLY_RESULTS)
+
+// STCMD_TIMING sets the timing mode of bus transactions. With
+// TIMING_ATOMIC, each set, pulse, and read of a register runs with
+// interrupts masked, so no ISR can stretch it. The mode is off when
+// the session is created.
+#define TIMING_ATOMIC       0x01
+
+// STCMD_JITTER times each bus primitive cmd[1] * JITTER_REPS_UNIT times
+// (at least once) in the current timing mode. The counted response has
+// the least and most CPU cycles of each, as 16-bit little endian values.
+// JITTER_EMPTY times nothing, which is the overhead the others include.
+#define JITTER_REPS_UNIT    64
+#define JITTER_LEAST        0   // 2 bytes
+#define JITTER_MOST         2   // 2 bytes
+#define JITTER_RANGE_SIZE   4
+#define JITTER_EMPTY        0   // offsets of the ranges
+#define JITTER_PULSE        4
+#define JITTER_SET          8
+#define JITTER_READ         12
+#define JITTER_SIZE         16
+
+// STCMD_LOAD appends vectors to the vector table, which holds up to
+// TABLE_VECTORS of them, and STCMD_REPLAY applies them. A vector is the
+// data and control bytes of an STCMD_APPLY, d0..d5 then ctl. The count
+// bytes that follow STCMD_LOAD are a piece of a compressed stream of
+// tokens, each of which gives one or more vectors in terms of the one
+// before it (all zero at first):
+//
+//   0x00..0x7F  bit i set: byte i of the vector follows (ctl is i = 6);
+//               the others are those of the previous vector
+//   0x80..0xBF  the previous vector again, (t & TABLE_RUN) + 1 times
+//   0xC0..0xFF  the vector (t & TABLE_RUN) + 2 back in the table
+//
+// A token and its bytes may be split across STCMD_LOADs. The ack of
+// STCMD_LOAD is sent after its last byte has been taken from the
+// receive buffers, so the host may count it in its window until then.
+//
+// STCMD_REPLAY applies the vectors in order, as STCMD_APPLY does
+// without APPLY_PIPELINED, then empties the table and makes the
+// previous vector zero again. Its count is the number of results: those
+// of each vector's reads, packed in slot order, one vector after
+// another with no padding. It must match the table. The results are
+// sent as the vectors are applied.
+#define TABLE_VECTORS       32
+#define TABLE_ROW           (LAYOUT_N_WRITES + 1)
+#define TABLE_CTL           0x40  // bit of a delta token for the control byte
+#define TABLE_REPEAT        0x80
+#define TABLE_COPY          0xC0
+#define TABLE_RUN           0x3F
+
+// STCMD_CHECKPOINT reports what the host needs to resume a run of
+// vectors after the link fails: the number of vectors applied, by
+// STCMD_APPLY (other than a flush) or STCMD_REPLAY, since the last
+// checkpoint or STCMD_LAYOUT, and the data last written to
+// each write slot of the layout, which is what the output registers
+// hold. Bit i of CHECKPOINT_VALID is set if slot i has been written
+// since the layout was set. The count is cleared.
+#define CHECKPOINT_APPLIED  0   // 2 bytes, little endian, modulo 65536
+#define CHECKPOINT_VALID    2
+#define CHECKPOINT_SHADOW   3   // LAYOUT_N_WRITES bytes
+#define CHECKPOINT_SIZE     (CHECKPOINT_SHADOW + LAYOUT_N_WRITES)
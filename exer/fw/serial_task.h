@@ -40,6 +40,18 @@ namespace SerialPrivate {
   constexpr byte MAX_CMD_SIZE = 8;
   constexpr int RING_BUF_SIZE = 16;
   constexpr int RING_MAX = (RING_BUF_SIZE - 1);
+
+  // The baud rate must match the host (cex). It's reported to the host
+  // in the capabilities response along with the buffer sizes above.
+  constexpr long SERIAL_BAUD = 115200;
+
+  // The size of the receive buffer in the Arduino core, which
+  // fills from the UART interrupt ahead of our receive ring.
+#ifdef SERIAL_RX_BUFFER_SIZE
+  constexpr byte CORE_RX_BUFFER_SIZE = SERIAL_RX_BUFFER_SIZE;
+#else
+  constexpr byte CORE_RX_BUFFER_SIZE = 64;
+#endif
   
   typedef struct ring {
     byte head;  // Add at the head
@@ -141,6 +153,375 @@ namespace SerialPrivate {
 
   // === end of the "lower layer" (ring buffer implementation) ===
 
+  // === Trace support ===
+
+  // In trace mode, we record when each command was first seen by
+  // process(), when its handler was called and returned, and when the
+  // last byte of its fixed response was handed to Serial. The host
+  // fetches the records with STCMD_GET_TRACE before the buffer fills,
+  // aligns them with its own clock, and draws them on a timeline.
+  // Poll and get-trace commands, whose responses are sent by the
+  // in-progress handler, aren't recorded.
+  //
+  // Recording costs a few micros() calls per command, so it's only
+  // done in trace mode.
+
+  constexpr byte TRACE_RECORDS = 16;
+
+  typedef struct traceRecord {
+    byte cmd;
+    byte mark;                // xmtBuf->head after the handler returned
+    unsigned long received;
+    ushort dispatched;        // deltas from received
+    ushort done;
+    ushort transmitted;
+  } TraceRecord;
+
+  TraceRecord traceRecords[TRACE_RECORDS];
+  bool tracing = false;
+  byte traceCount;            // records in use
+  byte traceXmtNext;          // oldest record not yet transmitted
+  byte traceDropped;
+  bool traceSeen;             // the command at the ring tail has been seen
+  unsigned long traceSeenAt;
+
+  void traceClear() {
+    traceCount = 0;
+    traceXmtNext = 0;
+    traceDropped = 0;
+    traceSeen = false;
+  }
+
+  // Return the microseconds from from to to, saturated at 0xFFFF.
+  ushort traceSpan(unsigned long from, unsigned long to) {
+    unsigned long d = to - from;
+    return (d > 0xFFFF) ? 0xFFFF : d;
+  }
+
+  ushort traceDelta(unsigned long from) {
+    return traceSpan(from, micros());
+  }
+
+  // Called by process() every time it looks at a command, which may
+  // be several times before the command is complete.
+  void traceSee() {
+    if (tracing && !traceSeen) {
+      traceSeenAt = micros();
+      traceSeen = true;
+    }
+  }
+
+  // Record a command whose handler was called at dispatchedAt and has
+  // just returned.
+  void traceRecord(byte cmd, unsigned long dispatchedAt) {
+    traceSeen = false;
+    if (cmd == STCMD_POLL || cmd == STCMD_GET_TRACE) {
+      return;
+    }
+    if (traceCount == TRACE_RECORDS) {
+      if (traceDropped != 0xFF) {
+        traceDropped++;
+      }
+      return;
+    }
+    TraceRecord* t = &traceRecords[traceCount++];
+    t->cmd = cmd;
+    t->mark = xmtBuf->head;
+    t->received = traceSeenAt;
+    t->dispatched = traceSpan(traceSeenAt, dispatchedAt);
+    t->done = traceDelta(traceSeenAt);
+    t->transmitted = 0xFFFF;
+  }
+
+  // Called after bytes have been taken from the transmit ring.
+  void traceTransmitted() {
+    while (traceXmtNext < traceCount && traceRecords[traceXmtNext].mark == xmtBuf->tail) {
+      TraceRecord* t = &traceRecords[traceXmtNext++];
+      t->transmitted = traceDelta(t->received);
+    }
+  }
+
+  void putLong(byte* bp, unsigned long v) {
+    for (int i = 0; i < 4; ++i, v >>= 8) {
+      bp[i] = v & 0xFF;
+    }
+  }
+
+  void putShort(byte* bp, ushort v) {
+    bp[0] = v & 0xFF;
+    bp[1] = v >> 8;
+  }
+
+  // Fill the poll buffer with the trace records and clear them. Return
+  // the length of the response.
+  int traceGetPending(byte* bp) {
+    putLong(bp + TRACE_HDR_NOW, micros());
+    bp[TRACE_HDR_DROPPED] = traceDropped;
+    bp += TRACE_HDR_SIZE;
+    for (int i = 0; i < traceCount; ++i, bp += TRACE_REC_SIZE) {
+      TraceRecord* t = &traceRecords[i];
+      bp[TRACE_REC_CMD] = t->cmd;
+      putLong(bp + TRACE_REC_RECEIVED, t->received);
+      putShort(bp + TRACE_REC_DISPATCH, t->dispatched);
+      putShort(bp + TRACE_REC_DONE, t->done);
+      putShort(bp + TRACE_REC_XMIT, t->transmitted);
+    }
+    int result = TRACE_HDR_SIZE + traceCount * TRACE_REC_SIZE;
+    traceClear();
+    return result;
+  }
+
+  // === end of trace support ===
+
+  // === Coverage support ===
+
+  // The bits of each register that have been written or read as one and
+  // as zero since the bitmaps were cleared, indexed by register ID, as
+  // they are on the wires. They tell the host which pins of the device a
+  // suite of vectors has exercised both ways without its fetching the raw
+  // results. Keeping them costs two ORs per register access. The host
+  // fetches them with STCMD_COVERAGE.
+
+  constexpr byte N_REGISTER_IDS = 16;
+
+  byte coverOnes[N_REGISTER_IDS];
+  byte coverZeros[N_REGISTER_IDS];
+
+  void coverClear() {
+    for (byte i = 0; i < N_REGISTER_IDS; ++i) {
+      coverOnes[i] = 0;
+      coverZeros[i] = 0;
+    }
+  }
+
+  void cover(byte id, byte data) {
+    coverOnes[id] |= data;
+    coverZeros[id] |= ~data;
+  }
+
+  // Write the coverage response into the buffer at bp and return its
+  // length.
+  int coverGetPending(byte* bp) {
+    for (byte i = 0; i < N_REGISTER_IDS; ++i) {
+      bp[COVER_ONES + i] = coverOnes[i];
+      bp[COVER_ZEROS + i] = coverZeros[i];
+    }
+    return COVER_SIZE;
+  }
+
+  // === end of coverage support ===
+
+  // === Vector application support ===
+
+  // STCMD_APPLY does the work of a vector's sets, pulses, and gets in
+  // one command, so there's one command to receive and acknowledge
+  // rather than a dozen. The reads are grouped so the data port turns
+  // around once for all of them instead of twice for each. The layout
+  // says which registers the vector uses; see serial_protocol.h. It
+  // lasts until the connection is resynchronized.
+
+  byte layout[LAYOUT_SLOTS];
+  byte shadow[LAYOUT_N_WRITES]; // data last written to each write slot
+  byte shadowValid;             // bit i set: shadow[i] is in the register
+  byte pendingReads;            // captured by a pipelined APPLY, not yet read
+  ushort applied;               // vectors applied since the last checkpoint
+
+  void applyReset() {
+    for (int i = 0; i < LAYOUT_SLOTS; ++i) {
+      layout[i] = LAYOUT_NONE;
+    }
+    shadowValid = 0;
+    pendingReads = 0;
+    applied = 0;
+  }
+
+  // Write d to the register in write slot i.
+  void applyWrite(byte i, byte d) {
+    byte id = layout[LAYOUT_WRITES + i];
+    if (id & LAYOUT_REVERSED) {
+      d = reverse_byte(d);
+    }
+    nanoSetRegister(id & LAYOUT_ID, d);
+    cover(id & LAYOUT_ID, d);
+  }
+
+  // Pulsing a register's clock latches whatever is on the data port, so
+  // forget the data of any write slot that uses register id.
+  void applyForget(byte id) {
+    for (byte i = 0; i < LAYOUT_N_WRITES; ++i) {
+      byte slot = layout[LAYOUT_WRITES + i];
+      if (slot != LAYOUT_NONE && (slot & LAYOUT_ID) == id) {
+        shadowValid &= ~(1 << i);
+      }
+    }
+  }
+
+  // Write the data to the registers in the write slots, skipping those
+  // that already hold it unless all is true. Output enables are written
+  // in two steps around the other writes, so that drivers turn off first
+  // and on last. All the drivers of an enables register whose value isn't
+  // known are turned off in the first step.
+  void applyWrites(const byte* data, bool all) {
+    byte changed = 0;
+    byte turnedOff = 0;           // enables written in the first step
+    byte off[LAYOUT_N_WRITES];
+    for (byte i = 0; i < LAYOUT_N_WRITES; ++i) {
+      byte id = layout[LAYOUT_WRITES + i];
+      byte bit = 1 << i;
+      bool known = !all && (shadowValid & bit);
+      if (id == LAYOUT_NONE || (known && shadow[i] == data[i])) {
+        continue;
+      }
+      changed |= bit;
+      if (id & LAYOUT_ENABLES) {
+        byte old = known ? shadow[i] : 0xFF;
+        off[i] = old | data[i];
+        if (!known || off[i] != old) {
+          turnedOff |= bit;
+          applyWrite(i, off[i]);
+        }
+      }
+    }
+    for (byte i = 0; i < LAYOUT_N_WRITES; ++i) {
+      byte bit = 1 << i;
+      if (!(changed & bit)) {
+        continue;
+      }
+      if (!(layout[LAYOUT_WRITES + i] & LAYOUT_ENABLES)) {
+        applyWrite(i, data[i]);
+      }
+      shadow[i] = data[i];
+      shadowValid |= bit;
+    }
+    for (byte i = 0; i < LAYOUT_N_WRITES; ++i) {
+      byte bit = 1 << i;
+      if ((changed & bit) && (layout[LAYOUT_WRITES + i] & LAYOUT_ENABLES) &&
+          (!(turnedOff & bit) || off[i] != data[i])) {
+        applyWrite(i, data[i]);
+      }
+    }
+  }
+
+  void applyPulse(byte slot) {
+    byte id = layout[slot];
+    if (id != LAYOUT_NONE) {
+      nanoTogglePulse(id & LAYOUT_ID);
+    }
+  }
+
+  // Read the input registers in mask, which have been captured, into
+  // the results, packed in slot order. The data port is left an input.
+  void applyReads(byte mask, byte* results) {
+    if (mask == 0) {
+      return;
+    }
+    nanoSetMode(portData, INPUT);
+    for (byte i = 0; i < LAYOUT_N_READS; ++i) {
+      if ((mask & (1 << i)) == 0) {
+        continue;
+      }
+      byte id = layout[LAYOUT_READS + i];
+      byte v = 0;
+      if (id != LAYOUT_NONE) {
+        v = nanoReadRegister(id & LAYOUT_ID);
+        cover(id & LAYOUT_ID, v);
+        if (id & LAYOUT_REVERSED) {
+          v = reverse_byte(v);
+        }
+      }
+      *results++ = v;
+    }
+  }
+
+  // === end of vector application support ===
+
+  // === Vector table support ===
+
+  // A suite of vectors mostly repeats the same control bytes with a
+  // few data bytes changing, so the host can send a batch of them
+  // compressed with STCMD_LOAD, several times faster than as separate
+  // STCMD_APPLYs, and apply the batch with one STCMD_REPLAY. The stream
+  // is decoded a byte at a time as it arrives, so none of it is held
+  // beyond the receive ring. See serial_protocol.h for the format.
+
+  byte table[TABLE_VECTORS][TABLE_ROW];
+  byte tableCount;              // vectors in the table
+  byte tableRow[TABLE_ROW];     // the last vector decoded
+  byte tableWanted;             // bytes of tableRow still to come, as in a delta token
+  byte tableLoadRemaining;      // bytes of the STCMD_LOAD in progress not yet decoded
+  byte tableReplayed;           // vectors applied by the STCMD_REPLAY in progress
+
+  void tableReset() {
+    tableCount = 0;
+    tableWanted = 0;
+    for (byte i = 0; i < TABLE_ROW; ++i) {
+      tableRow[i] = 0;
+    }
+  }
+
+  // Append tableRow to the table. Return false if it's full.
+  bool tableAppend() {
+    if (tableCount == TABLE_VECTORS) {
+      return false;
+    }
+    byte* v = table[tableCount++];
+    for (byte i = 0; i < TABLE_ROW; ++i) {
+      v[i] = tableRow[i];
+    }
+    return true;
+  }
+
+  // Decode the next byte c of the stream. Return false if the stream
+  // overflows the table or copies a vector that isn't there.
+  bool tableDecode(byte c) {
+    if (tableWanted != 0) {
+      byte i = 0;
+      while (!(tableWanted & (1 << i))) {
+        ++i;
+      }
+      tableRow[i] = c;
+      tableWanted &= ~(1 << i);
+      return tableWanted != 0 || tableAppend();
+    }
+    if ((c & TABLE_COPY) == TABLE_COPY) {
+      byte back = (c & TABLE_RUN) + 2;
+      if (back > tableCount) {
+        return false;
+      }
+      const byte* v = table[tableCount - back];
+      for (byte i = 0; i < TABLE_ROW; ++i) {
+        tableRow[i] = v[i];
+      }
+      return tableAppend();
+    }
+    if (c & TABLE_REPEAT) {
+      for (byte n = (c & TABLE_RUN) + 1; n > 0; --n) {
+        if (!tableAppend()) {
+          return false;
+        }
+      }
+      return true;
+    }
+    tableWanted = c;
+    return c != 0 || tableAppend();
+  }
+
+  // Return the number of input registers in reads.
+  byte readCount(byte reads) {
+    return (reads & 1) + ((reads >> 1) & 1) + ((reads >> 2) & 1);
+  }
+
+  // Return the number of results the vectors in the table return.
+  byte tableResults() {
+    byte n = 0;
+    for (byte i = 0; i < tableCount; ++i) {
+      n += readCount(table[i][LAYOUT_N_WRITES] & APPLY_READS);
+    }
+    return n;
+  }
+
+  // === end of vector table support ===
+
   // === the "middle layer": connection state and send/receive ===
 
   // State of the connection. There are actually four states, as the
@@ -172,6 +553,12 @@ namespace SerialPrivate {
     xmtBuf->tail = 0;
     inProgress = 0;
     state = STATE_UNSYNC;
+    tracing = false;
+    traceClear();
+    coverClear();
+    nanoAtomicBus = false;
+    applyReset();
+    tableReset();
   }
 
   // Return true if the byte is a valid command byte.
@@ -222,18 +609,26 @@ namespace SerialPrivate {
   // command handler to process multiple calls.
   typedef State (*CommandHandler)(RING *const r, byte b);
 
-  // The poll buffer (serial output buffer) is the single largest
-  // user of RAM in the entire system. It allows us to hide the
-  // nonblocking nature of the code from functions that want to
-  // generate data for the host, allowing use of e.g. xnprintf().
-  // It's 259 to allow for a command byte, a count byte, 255 data
-  // bytes, an unneeded terminating nul should it be written by a
-  // library function, and a guard byte at the end.
+  // The poll buffers (serial output buffers) are the largest users of
+  // RAM in the entire system. They allow us to hide the nonblocking
+  // nature of the code from functions that want to generate data for
+  // the host, allowing use of e.g. xnprintf(). Each is 259 bytes to
+  // allow for a command byte, a count byte, 255 data bytes, an unneeded
+  // terminating nul should it be written by a library function, and a
+  // guard byte at the end.
+  //
+  // There are two, so one can be filled while the other is still being
+  // sent. A log message keeps its buffer until its last frame has been
+  // sent, and a counted command response uses the other. The handler
+  // that sends one doesn't return until it's sent, so no more than two
+  // are ever needed. While a buffer waits for the transmit ring, the
+  // next log message is formatted into the other, if it's free.
   //
   // As noted above, the USB serial line is not flow controlled.
   // The logic relies on the fact that the Nano cannot in practice
   // overrun the much faster host.
 
+  constexpr int POLL_BUFFERS = 2;
   constexpr int POLL_BUF_SIZE = 259;
   constexpr int POLL_BUF_LAST = (POLL_BUF_SIZE - 1);
   constexpr int POLL_BUF_MAX_DATA = 255;
@@ -247,42 +642,101 @@ namespace SerialPrivate {
     byte buf[POLL_BUF_SIZE];
   } PollBuffer;
 
-  PollBuffer uniquePollBuffer;
-  PollBuffer* const pb = &uniquePollBuffer;
-
-  // Allocate the poll buffer.
-  // panic: poll buffer in use.
-  void allocPollBuffer() {
-    if (pb->inuse) {
-      panic(PANIC_SERIAL_NUMBERED, 0xD);
+  PollBuffer pollBuffers[POLL_BUFFERS];
+  PollBuffer* sending;      // the buffer being sent by pollResponseInProgress()
+
+  // Allocate a poll buffer.
+  // panic: both poll buffers in use.
+  PollBuffer* allocPollBuffer() {
+    for (int i = 0; i < POLL_BUFFERS; ++i) {
+      PollBuffer* const p = &pollBuffers[i];
+      if (!p->inuse) {
+        p->inuse = true;
+        p->remaining = 0;
+        p->next = 0;
+        p->buf[POLL_BUF_LAST] = GUARD_BYTE;
+        return p;
+      }
     }
-    pb->inuse = true;
-    pb->remaining = 0;
-    pb->next = 0;
-    pb->buf[POLL_BUF_LAST] = GUARD_BYTE;
+    panic(PANIC_SERIAL_NUMBERED, 0xD);
+    return 0;
   }
 
-  // Free the poll buffer
+  // Free a poll buffer
   // panic: poll buffer is not in use
   // panic: the guard byte was overwritten.
-  void freePollBuffer() {
-    if (!pb->inuse) {
+  void freePollBuffer(PollBuffer* const p) {
+    if (!p->inuse) {
       panic(PANIC_SERIAL_NUMBERED, 0xE);
     }
-    if (pb->buf[POLL_BUF_LAST] != GUARD_BYTE) {
+    if (p->buf[POLL_BUF_LAST] != GUARD_BYTE) {
       panic(PANIC_SERIAL_NUMBERED, 0xA);
     }
-    pb->next = 0;
-    pb->remaining = 0;
-    pb->inuse = false;
+    p->next = 0;
+    p->remaining = 0;
+    p->inuse = false;
+  }
+
+  // === Log frames ===
+
+  // Log messages share the link with command responses, and a poll
+  // response holds up the commands behind it until it has been sent.
+  // So a message is formatted into a poll buffer once and sent a frame
+  // at a time, LOG_FRAME_SIZE bytes per poll, which bounds the delay.
+  // While the host is sending hardware commands, frames are sent at
+  // most every LOG_BUSY_INTERVAL_MILLIS and other polls are answered
+  // with nothing.
+
+  constexpr unsigned long LOG_BUSY_MILLIS = 100;         // busy if a hardware command is this recent
+  constexpr unsigned long LOG_BUSY_INTERVAL_MILLIS = 50; // frame interval while busy
+
+  PollBuffer* logBuffer;         // holds the message being framed, or the next one
+  int logRemaining;              // bytes of it not yet framed
+  unsigned long hardwareMillis;  // when the last hardware command ran
+  unsigned long frameMillis;     // when the last frame was sent
+
+  void logHardwareCommand() {
+    hardwareMillis = millis();
+  }
+
+  bool logThrottled() {
+    unsigned long now = millis();
+    return now - hardwareMillis < LOG_BUSY_MILLIS && now - frameMillis < LOG_BUSY_INTERVAL_MILLIS;
+  }
+
+  // Make sure logBuffer holds a message, if there is one. The caller
+  // must leave a poll buffer free for the message. Return true if
+  // there's a message to frame.
+  bool logFill() {
+    if (logBuffer != 0) {
+      return true;
+    }
+    if (logIsEmpty()) {
+      return false;
+    }
+    PollBuffer* const p = allocPollBuffer();
+    int n = logGetPending((char *)p->buf, POLL_BUF_MAX_DATA);
+    if (n <= 0) {
+      freePollBuffer(p);
+      return false;
+    }
+    logBuffer = p;
+    logRemaining = n;
+    return true;
   }
 
   void internalSerialReset() {
     stateUnsync();
-    pb->inuse = false;
-    pb->remaining = 0;
-    pb->next = 0;
-    pb->buf[POLL_BUF_LAST] = GUARD_BYTE;
+    for (int i = 0; i < POLL_BUFFERS; ++i) {
+      PollBuffer* const p = &pollBuffers[i];
+      p->inuse = false;
+      p->remaining = 0;
+      p->next = 0;
+      p->buf[POLL_BUF_LAST] = GUARD_BYTE;
+    }
+    sending = 0;
+    logBuffer = 0;
+    logRemaining = 0;
   }
 
   // === end of the "middle layer" ===
@@ -347,39 +801,170 @@ namespace SerialPrivate {
     return state;
   }
 
+  // The optional protocol features this firmware supports, reported
+  // by stGetCaps(). See CAP_ in serial_protocol.h.
+  constexpr ushort CAPABILITIES = CAP_PIPELINE | CAP_TRACE | CAP_APPLY | CAP_ENABLES | CAP_LOG_FRAMES | CAP_COVERAGE | CAP_CLOCKS | CAP_TIMING | CAP_REPLAY | CAP_CHECKPOINT;
+
   // In-progress handler for transmitting buffered
-  // messages from the poll buffer to the host. Transmit
-  // as much of the poll buffer as possible. If finished,
-  // free the buffer and clear the inProgress handler.
+  // messages from a poll buffer to the host. Transmit
+  // as much of the buffer as possible. If finished,
+  // free the buffer (unless it holds more frames of a log
+  // message) and clear the inProgress handler. If not,
+  // use the wait to format the next log message.
   State pollResponseInProgress() {
-    while (canSend(1) && pb->remaining > 0) {
-      send(pb->buf[pb->next]);
-      pb->remaining--;
-      pb->next++;
+    while (canSend(1) && sending->remaining > 0) {
+      send(sending->buf[sending->next]);
+      sending->remaining--;
+      sending->next++;
     }
-    if (pb->remaining == 0) {
-      freePollBuffer();
-      inProgress = 0;              
+    if (sending->remaining == 0) {
+      if (sending != logBuffer) {
+        freePollBuffer(sending);
+      }
+      sending = 0;
+      inProgress = 0;
+    } else if (logBuffer == 0) {
+      logFill();
     }
     return state;
   }
 
-  // Respond to a poll request from the host.
+  // Send count bytes of the poll buffer p, starting at p->next, as a
+  // counted response. The caller has sent the ack and the count.
+  State sendPollBuffer(PollBuffer* const p, int count) {
+    p->remaining = count;
+    sending = p;
+    inProgress = pollResponseInProgress;
+    return pollResponseInProgress();
+  }
+
+  // Respond to a poll request from the host with the next frame of
+  // the log message in progress, or of the next message, if any.
   State stPoll(RING* const r, byte b) {    
     consume(r, 1);
     sendAck(b);
-    if (logIsEmpty()) {
-      // usual case
+    if (logThrottled() || !logFill()) {
+      // usual case: nothing to send, or not now
       send(0);
       return state;
     }
 
-    allocPollBuffer();
-    pb->remaining = logGetPending((char *)pb->buf, POLL_BUF_MAX_DATA);
-    send(pb->remaining); // byte count follows ack back to host
-    pb->next = 0;
-    inProgress = pollResponseInProgress;
-    return pollResponseInProgress();
+    PollBuffer* const p = logBuffer;
+    byte n = (logRemaining > LOG_FRAME_SIZE) ? LOG_FRAME_SIZE : logRemaining;
+    logRemaining -= n;
+    send(logRemaining != 0 ? n | LOG_MORE : n); // byte count follows ack back to host
+    if (logRemaining == 0) {
+      logBuffer = 0; // freed when the last frame has been sent
+    }
+    frameMillis = millis();
+    return sendPollBuffer(p, n);
+  }
+
+  // Respond to a capabilities request. The response is counted like a
+  // poll response and is sent from a poll buffer the same way. It
+  // describes the buffering and optional features of this firmware so
+  // the host can choose how to drive it.
+  State stGetCaps(RING* const r, byte b) {
+    consume(r, 1);
+    sendAck(b);
+
+    PollBuffer* const p = allocPollBuffer();
+    byte* caps = p->buf;
+    caps[CAPS_VERSION] = PROTOCOL_VERSION;
+    caps[CAPS_BITS] = CAPABILITIES & 0xFF;
+    caps[CAPS_BITS + 1] = CAPABILITIES >> 8;
+    caps[CAPS_RCV_RING] = RING_BUF_SIZE;
+    caps[CAPS_RX_BUFFER] = CORE_RX_BUFFER_SIZE;
+    caps[CAPS_MAX_CMD] = MAX_CMD_SIZE;
+    caps[CAPS_MAX_PAYLOAD] = POLL_BUF_MAX_DATA;
+    caps[CAPS_BAUD] = (SERIAL_BAUD / 100) & 0xFF;
+    caps[CAPS_BAUD + 1] = (SERIAL_BAUD / 100) >> 8;
+    send(CAPS_SIZE);
+    return sendPollBuffer(p, CAPS_SIZE);
+  }
+
+  // Turn trace mode on (cmd[1] != 0) or off. Turning it on discards
+  // any records. The fixed response is the number of trace records.
+  State stTrace(RING* const r, byte b) {
+    byte traceCmd[2];
+    copy(r, traceCmd, 2);
+    consume(r, 2);
+    tracing = (traceCmd[1] != 0);
+    if (tracing) {
+      traceClear();
+    }
+    sendAck(b);
+    send(TRACE_RECORDS);
+    return state;
+  }
+
+  // Send and clear the trace records. The response is counted
+  // and is sent from a poll buffer like a poll response.
+  State stGetTrace(RING* const r, byte b) {
+    consume(r, 1);
+    sendAck(b);
+
+    PollBuffer* const p = allocPollBuffer();
+    int n = traceGetPending(p->buf);
+    send(n);
+    return sendPollBuffer(p, n);
+  }
+
+  // Send the coverage bitmaps, and clear them if cmd[1] has
+  // COVER_CLEAR. The response is counted and is sent from a poll
+  // buffer like a poll response.
+  State stCoverage(RING* const r, byte b) {
+    byte coverCmd[2];
+    copy(r, coverCmd, 2);
+    consume(r, 2);
+    sendAck(b);
+
+    PollBuffer* const p = allocPollBuffer();
+    int n = coverGetPending(p->buf);
+    if (coverCmd[1] & COVER_CLEAR) {
+      coverClear();
+    }
+    send(n);
+    return sendPollBuffer(p, n);
+  }
+
+  // Set the timing mode of bus transactions from cmd[1].
+  State stTiming(RING* const r, byte b) {
+    byte timingCmd[2];
+    copy(r, timingCmd, 2);
+    consume(r, 2);
+    nanoAtomicBus = (timingCmd[1] & TIMING_ATOMIC) != 0;
+    sendAck(b);
+    return state;
+  }
+
+  // Time the bus primitives cmd[1] * JITTER_REPS_UNIT times each and
+  // send the range of cycles each took. The response is counted and is
+  // sent from a poll buffer like a poll response. This takes up to a
+  // second, during which the Nano does nothing else.
+  State stJitter(RING* const r, byte b) {
+    byte jitterCmd[2];
+    copy(r, jitterCmd, 2);
+    consume(r, 2);
+    unsigned int reps = jitterCmd[1] * JITTER_REPS_UNIT;
+    if (reps == 0) {
+      reps = 1;
+    }
+
+    JitterRange jitter[JITTER_N_PRIMITIVES];
+    nanoMeasureJitter(jitter, reps);
+    sendAck(b);
+
+    PollBuffer* const p = allocPollBuffer();
+    byte* bp = p->buf;
+    for (byte i = 0; i < JITTER_N_PRIMITIVES; ++i, bp += JITTER_RANGE_SIZE) {
+      bp[JITTER_LEAST] = jitter[i].least & 0xFF;
+      bp[JITTER_LEAST + 1] = jitter[i].least >> 8;
+      bp[JITTER_MOST] = jitter[i].most & 0xFF;
+      bp[JITTER_MOST + 1] = jitter[i].most >> 8;
+    }
+    send(JITTER_SIZE);
+    return sendPollBuffer(p, JITTER_SIZE);
   }
 
   // *** Chip exerciser commands. ***
@@ -402,6 +987,8 @@ namespace SerialPrivate {
     for (int i = 0; i < pulseCmd[1]; ++i) {
       nanoTogglePulse(pulseCmd[2]);
     }
+    shadowValid = 0;
+    logHardwareCommand();
     sendAck(b);
     return state;
   }
@@ -424,7 +1011,19 @@ namespace SerialPrivate {
     if (b == STCMD_SETR) {
       data = reverse_byte(setCmd[2]);
     }
+
+    // The low order 4 bits of U10 are output enables for other output
+    // registers, which drive pins of the ZIF socket that may also be
+    // outputs of the device. STCMD_APPLY manages them for ZIF vectors
+    // (see LAYOUT_ENABLES). A plain set keeps them low, enabling the
+    // registers, as the PLCC needs.
+    if (setCmd[1] == RI_U10_CLK) {
+      data &= 0xF0;
+    }
     nanoSetRegister(setCmd[1], data);
+    cover(setCmd[1], data);
+    shadowValid = 0;
+    logHardwareCommand();
     sendAck(b);
     return state;
   }
@@ -441,14 +1040,201 @@ namespace SerialPrivate {
       stBadCmd(r, b);
     }
     byte result = nanoGetRegister(getCmd[1]);
+    cover(getCmd[1], result);
     if (b == STCMD_GETR) {
       result = reverse_byte(result);
     }
+    logHardwareCommand();
     sendAck(b);
     send(result);
     return state;
   }
   
+  // Set layout slot cmd[1] to the register ID cmd[2].
+  State stLayout(RING* const r, byte b) {
+    byte layoutCmd[3];
+    copy(r, layoutCmd, 3);
+    consume(r, 3);
+    byte id = layoutCmd[2];
+    if (layoutCmd[1] >= LAYOUT_SLOTS ||
+        (id != LAYOUT_NONE && (id & ~(LAYOUT_ID | LAYOUT_REVERSED | LAYOUT_ENABLES)) != 0)) {
+      return stBadCmd(r, b);
+    }
+    layout[layoutCmd[1]] = id;
+    applied = 0;
+    if (layoutCmd[1] < LAYOUT_WRITES + LAYOUT_N_WRITES) {
+      shadowValid &= ~(1 << (layoutCmd[1] - LAYOUT_WRITES));
+    }
+    sendAck(b);
+    return state;
+  }
+
+  // Apply one vector: write the data to the output registers, pulse the
+  // clock, and capture and read the input registers into the results, as
+  // ctl directs. In pipelined mode, first read what the previous vector
+  // captured; then the reads and this vector's writes share one
+  // turnaround of the data port, and this vector's captures wait in the
+  // input registers for the next.
+  void applyVector(const byte* data, byte ctl, byte* results) {
+    byte reads = ctl & APPLY_READS;
+    if (ctl & APPLY_PIPELINED) {
+      applyReads(pendingReads, results);
+      pendingReads = reads;
+    }
+    if (!(ctl & APPLY_NO_WRITES)) {
+      applyWrites(data, ctl & APPLY_WRITE_ALL);
+      applied++;
+    }
+    if (ctl & APPLY_CLOCK) {
+      applyPulse(LAYOUT_CLOCK);
+    }
+    for (byte i = 0; i < LAYOUT_N_READS; ++i) {
+      if (reads & (1 << i)) {
+        applyPulse(LAYOUT_CAPTURES + i);
+      }
+    }
+    if (!(ctl & APPLY_PIPELINED)) {
+      applyReads(reads, results);
+      pendingReads = 0;
+    }
+    nanoSetMode(portData, OUTPUT);
+    logHardwareCommand();
+  }
+
+  // Apply the vector in cmd[2..] as cmd[1] directs.
+  State stApply(RING* const r, byte b) {
+    byte applyCmd[2 + LAYOUT_N_WRITES];
+    copy(r, applyCmd, sizeof(applyCmd));
+    consume(r, sizeof(applyCmd));
+    byte results[APPLY_RESULTS] = {0, 0, 0};
+    applyVector(applyCmd + 2, applyCmd[1], results);
+
+    sendAck(b);
+    for (byte i = 0; i < APPLY_RESULTS; ++i) {
+      send(results[i]);
+    }
+    return state;
+  }
+
+  // Run the clock phases in cmd[1..]: for each, pulse its register its
+  // count times, then capture and read the input registers in its reads,
+  // using the capture and read slots of the layout. Each phase's results
+  // are packed at its own APPLY_RESULTS bytes of the response.
+  State stClocks(RING* const r, byte b) {
+    byte clocksCmd[1 + 2 * CLOCK_PHASES];
+    copy(r, clocksCmd, sizeof(clocksCmd));
+    consume(r, sizeof(clocksCmd));
+    byte results[CLOCK_RESULTS];
+    for (byte i = 0; i < CLOCK_RESULTS; ++i) {
+      results[i] = 0;
+    }
+
+    for (byte p = 0; p < CLOCK_PHASES; ++p) {
+      byte ctl = clocksCmd[1 + 2 * p];
+      byte count = clocksCmd[2 + 2 * p];
+      byte reads = (ctl & CLOCK_READS) >> CLOCK_READS_SHIFT;
+      for (byte i = 0; i < count; ++i) {
+        nanoTogglePulse(ctl & CLOCK_ID);
+      }
+      if (count != 0) {
+        applyForget(ctl & CLOCK_ID);
+      }
+      for (byte i = 0; i < LAYOUT_N_READS; ++i) {
+        if (reads & (1 << i)) {
+          applyPulse(LAYOUT_CAPTURES + i);
+        }
+      }
+      applyReads(reads, results + p * APPLY_RESULTS);
+    }
+    nanoSetMode(portData, OUTPUT);
+    logHardwareCommand();
+
+    sendAck(b);
+    for (byte i = 0; i < CLOCK_RESULTS; ++i) {
+      send(results[i]);
+    }
+    return state;
+  }
+
+  // In-progress handler for STCMD_LOAD. Decode the bytes of its stream
+  // as they arrive, and ack the command when the last is in.
+  State loadInProgress() {
+    while (tableLoadRemaining > 0 && len(rcvBuf) > 0) {
+      byte c = peek(rcvBuf);
+      consume(rcvBuf, 1);
+      tableLoadRemaining--;
+      if (!tableDecode(c)) {
+        return stBadCmd(rcvBuf, STCMD_LOAD);
+      }
+    }
+    if (tableLoadRemaining == 0 && canSend(1)) {
+      sendAck(STCMD_LOAD);
+      inProgress = 0;
+    }
+    return state;
+  }
+
+  // Add the vectors in the cmd[1] bytes of stream that follow the
+  // command to the vector table.
+  State stLoad(RING* const r, byte b) {
+    byte loadCmd[2];
+    copy(r, loadCmd, 2);
+    consume(r, 2);
+    tableLoadRemaining = loadCmd[1];
+    inProgress = loadInProgress;
+    return loadInProgress();
+  }
+
+  // In-progress handler for STCMD_REPLAY. Apply the vectors of the table
+  // in turn, each when there's room to send its results, and empty the
+  // table after the last.
+  State replayInProgress() {
+    while (tableReplayed < tableCount && canSend(APPLY_RESULTS)) {
+      const byte* v = table[tableReplayed++];
+      byte ctl = v[LAYOUT_N_WRITES] & ~APPLY_PIPELINED;
+      byte results[APPLY_RESULTS];
+      applyVector(v, ctl, results);
+      for (byte i = 0, n = readCount(ctl & APPLY_READS); i < n; ++i) {
+        send(results[i]);
+      }
+    }
+    if (tableReplayed == tableCount) {
+      tableReset();
+      inProgress = 0;
+    }
+    return state;
+  }
+
+  // Apply the vectors of the table. cmd[1] is the number of results
+  // the host expects, which must be what they return.
+  State stReplay(RING* const r, byte b) {
+    byte replayCmd[2];
+    copy(r, replayCmd, 2);
+    consume(r, 2);
+    if (tableWanted != 0 || replayCmd[1] != tableResults()) {
+      return stBadCmd(r, b);
+    }
+    sendAck(b);
+    tableReplayed = 0;
+    inProgress = replayInProgress;
+    return replayInProgress();
+  }
+
+  // Report the vectors applied since the last checkpoint and the data
+  // in the output registers, and start counting again.
+  State stCheckpoint(RING* const r, byte b) {
+    consume(r, 1);
+    sendAck(b);
+    send(applied & 0xFF);
+    send(applied >> 8);
+    send(shadowValid);
+    for (byte i = 0; i < LAYOUT_N_WRITES; ++i) {
+      send(shadow[i]);
+    }
+    applied = 0;
+    return state;
+  }
+
   // *** End of command implementations ***
 
   typedef struct commandData {
@@ -465,20 +1251,20 @@ namespace SerialPrivate {
     { stGetVer,     1 },
     { stPoll,       1 },
 
-    { stUndef,      1 }, // 0xE4
-    { stUndef,      1 },
-    { stUndef,      1 },
-    { stUndef,      1 },
+    { stGetCaps,    1 }, // 0xE4
+    { stTrace,      2 }, // 0xE5 on/off
+    { stGetTrace,   1 },
+    { stCoverage,   2 }, // 0xE7 flags
 
-    { stUndef,      1 }, // 0xE8
-    { stUndef,      1 },
-    { stUndef,      1 },
-    { stUndef,      1 },
+    { stLayout,     3 }, // 0xE8 slot id
+    { stApply,      8 }, // 0xE9 ctl d0..d5
+    { stClocks,     7 }, // 0xEA (ctl count) x 3
+    { stTiming,     2 }, // 0xEB flags
 
-    { stUndef,      1 }, // 0xEC
-    { stUndef,      1 },
-    { stUndef,      1 },
-    { stUndef,      1 },
+    { stJitter,     2 }, // 0xEC reps / 64
+    { stLoad,       2 }, // 0xED count, then count bytes
+    { stReplay,     2 }, // 0xEE count of results
+    { stCheckpoint, 1 }, // 0xEF
   
     { stPulse,      3 }, // 0xF0 ct id
     { stUndef,      1 },
@@ -501,15 +1287,17 @@ namespace SerialPrivate {
     { stBadCmd,     1 },
   };
 
-  // The maximum fixed response currently specified by the protocol is 1
-  // result byte in addition to the ack or nak. This result byte may be a
+  // The maximum fixed response currently specified by the protocol is the
+  // CLOCK_RESULTS bytes of STCMD_CLOCKS in addition to the ack or nak. For
+  // other commands the fixed response is at most one byte, which may be a
   // value or may be a byte count of variable bytes to follow. This is
   // checked by the top-level handler to ensure that called handler
   // subfunctions that transmit only the fixed response won't block
   // waiting for room in the transmit buffer. Functions that transmit
   // larger, variable-length responses return a count as the fixed result
   // and then must handle blocking while transmitting.
-  constexpr byte MAX_FIXED_RESPONSE_BYTES = 2;
+  constexpr byte MAX_FIXED_RESPONSE_BYTES = 1 + CLOCK_RESULTS;
+  static_assert(CHECKPOINT_SIZE <= CLOCK_RESULTS, "checkpoint response too large");
 
   // There is at least one command byte waiting to be processed in the
   // receive- side ring buffer at r. The command handler may or may not
@@ -522,6 +1310,7 @@ namespace SerialPrivate {
 
     CommandHandler handler;
     byte cmdLen = pgm_read_ptr_near(&handlers[b - STCMD_BASE].length);
+    traceSee();
     if (len(rcvBuf) < cmdLen || avail(xmtBuf) < MAX_FIXED_RESPONSE_BYTES) {
       // Come back later after more bytes arrive or go out. Checking this
       // here means individual handlers can assume their command is fully
@@ -529,7 +1318,19 @@ namespace SerialPrivate {
       return state;
     }
     handler = pgm_read_ptr_near(&handlers[b - STCMD_BASE].handler);
-    return (*handler)(r, b);
+    // The handler's time, not counting any in-progress handler it
+    // starts, goes to the heartbeat's slowest command statistics.
+    Ticks before = timeNow();
+    if (!tracing) {
+      State next = (*handler)(r, b);
+      hbCommandTime(b, timeNow() - before);
+      return next;
+    }
+    unsigned long dispatchedAt = micros();
+    State next = (*handler)(r, b);
+    hbCommandTime(b, timeNow() - before);
+    traceRecord(b, dispatchedAt);
+    return next;
   }
 
   // The serial task. Called as often as possible (no delay).
@@ -546,6 +1347,9 @@ namespace SerialPrivate {
         panic(PANIC_SERIAL_NUMBERED, 9);
       }
       consume(xmtBuf, 1);
+      if (tracing) {
+        traceTransmitted();
+      }
     }
 
     while (!isFull(rcvBuf) && Serial.available()) {
@@ -588,7 +1392,7 @@ void serialTaskInit() {
   SetDisplay(TRACE_BEFORE_SERIAL_INIT);
   SerialPrivate::stateUnsync();
 
-  Serial.begin(115200);
+  Serial.begin(SerialPrivate::SERIAL_BAUD);
   while (!Serial) {
     ; // wait for serial port to connect.
   }
@@ -597,3 +1401,15 @@ void serialTaskInit() {
 int serialTaskBody() {
   return SerialPrivate::serialTask();
 }
+
+// Return true if a command is in progress or has begun to arrive, so
+// work that can wait should wait.
+bool serialIsBusy() {
+  return SerialPrivate::inProgress != 0 || SerialPrivate::len(SerialPrivate::rcvBuf) > 0 || Serial.available() > 0;
+}
+
+// Return the time in millis() of the last command that touched the
+// exerciser's registers.
+unsigned long serialHardwareMillis() {
+  return SerialPrivate::hardwareMillis;
+}
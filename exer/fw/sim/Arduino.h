@@ -0,0 +1,110 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+//
+// Just enough of the Arduino environment to build the firmware on the
+// host. The ATmega's I/O registers are objects that report every read
+// and write to the board model (board.h), which plays the part of the
+// external registers and decoders and whatever is in the sockets. The
+// USB serial port is a pseudo-terminal; see sim_main.cpp.
+//
+// Nothing here is part of the firmware proper, which must still build
+// unchanged in the Arduino IDE.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef uint8_t byte;
+
+// Program memory is ordinary memory on the host
+#define PROGMEM
+#define PSTR(s) (s)
+#define snprintf_P snprintf
+#define pgm_read_ptr_near(p) (*(p))
+#define pgm_read_byte_near(p) (*(p))
+#define _BV(b) (1 << (b))
+
+#define OUTPUT 1
+#define INPUT 0
+#define HIGH 1
+#define LOW 0
+
+// Bit numbers used by the firmware
+#define PORTC3 3
+#define PORTC4 4
+#define DDC3 3
+#define DDC4 4
+
+// The I/O registers used by the firmware. Each has an identity so the
+// board model knows which one was touched.
+enum SimRegId : byte { SIM_PORTB, SIM_PORTC, SIM_PORTD, SIM_DDRB, SIM_DDRC, SIM_DDRD,
+                       SIM_PINB, SIM_PINC, SIM_PIND, SIM_SREG, SIM_NREGS };
+
+// Implemented by the board model
+byte simReadRegister(SimRegId id, byte value);
+void simWriteRegister(SimRegId id, byte value);
+
+class SimRegister {
+ public:
+  explicit SimRegister(SimRegId id) : id_(id), value_(0) {}
+
+  operator byte() const { return simReadRegister(id_, value_); }
+
+  SimRegister& operator=(int v) {
+    value_ = byte(v);
+    simWriteRegister(id_, value_);
+    return *this;
+  }
+  SimRegister& operator=(const SimRegister& r) { return *this = int(byte(r)); }
+  SimRegister& operator|=(int v) { return *this = value_ | v; }
+  SimRegister& operator&=(int v) { return *this = value_ & v; }
+
+  byte value() const { return value_; }
+
+ private:
+  SimRegId id_;
+  byte value_;
+};
+
+extern SimRegister PORTB, PORTC, PORTD, DDRB, DDRC, DDRD, PINB, PINC, PIND, SREG;
+
+#define cli() (SREG &= ~0x80)
+#define sei() (SREG |= 0x80)
+
+// Timer1, which the firmware runs undivided to time the bus. The control
+// registers are plain memory and TCNT1 counts at 16MHz of simulated time.
+// The firmware's time base, which is Timer1 at clk/8 with an overflow
+// interrupt on the Nano, is micros() here.
+extern byte TCCR1A, TCCR1B;
+#define CS10 0
+uint16_t simTimer1();
+#define TCNT1 (simTimer1())
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+unsigned long millis();
+unsigned long micros();
+
+// The USB serial port. The receive buffer is the size of the Arduino
+// core's, and bytes that arrive when it's full are lost, as they would
+// be on the Nano.
+#define SERIAL_RX_BUFFER_SIZE 64
+
+class SimSerial {
+ public:
+  void begin(long baud);
+  operator bool() const { return true; }
+  int available();
+  int read();
+  int availableForWrite();
+  size_t write(uint8_t b);
+};
+
+extern SimSerial Serial;
+
+// Called by the firmware's panic(); reports the panic and exits.
+void simPanic(byte panicCode, byte subcode);
@@ -0,0 +1,409 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+//
+// Model of the exerciser board. The decoders are driven by PORTC: bits
+// 0..2 are the address bussed to both decoders and bits 3 and 4 are the
+// enables of the low (IDs 0..7) and high (IDs 8..15) decoder. A decoder
+// output is asserted (low) while its decoder is enabled and addressed.
+// Registers are clocked when their decoder output is deasserted, i.e. on
+// its rising edge, which is when the firmware expects them to be.
+//
+// The Nano's I/O bus is the data port: PORTD bits 5..7 are bus bits 0..2
+// and PORTB bits 0..4 are bus bits 3..7. The Nano drives the bits whose
+// DDR bits are set. An input register drives the bus while its output
+// enable (a decoder output) is asserted. Bits nobody drives read high.
+//
+// Socket wiring, from the host's vector compiler (cex/vector.go) and the
+// README files. U10 is written bit reversed by the firmware; its bits
+// here are as they appear at the register.
+//
+//   PLCC pins 1..8      U4 bits 0..7 (A<7:0>)
+//   PLCC pins 9..16     U5 bits 0..7 (A<15:8>)
+//   PLCC pin 17         TSTCLK (decoder output 8)
+//   PLCC pins 20..24    captured by U11 bits 0..4 (C, P, G, Z, V)
+//   PLCC pins 25..27    U8 bits 2..0
+//   PLCC pins 28..35    captured by U3 bits 7..0 (F<15:8>)
+//   PLCC pins 36..43    captured by U7 bits 7..0 (F<7:0>)
+//   PLCC pins 44..48    U8 bits 3..7
+//   PLCC pins 49..52    U10 bits 3..0
+//   PLCC pins 53..60    U1 bits 0..7 (B<7:0>)
+//   PLCC pins 61..68    U2 bits 0..7 (B<15:8>)
+//
+// U10 bits 7, 6, and 5 are the active low output enables of U1, U2, and
+// U8. The ZIF socket is wired to the same registers. Its pins are both
+// driven by an output register and captured by an input register:
+//
+//   ZIF pin 1           TSTCLK; captured by U3 bit 0
+//   ZIF pins 2..8       U1 bits 1..7; captured by U3 bits 1..7
+//   ZIF pins 9..16      U2 bits 0..7; captured by U7 bits 0..7
+//   ZIF pins 17..24     U8 bits 0..7; captured by U11 bits 0..7
+//
+// The ZIF wiring is as designed but not yet built, so it's provisional.
+// The simulator holds one device, in either socket. Where both the board
+// and the device drive a pin, the device wins, and it's a violation.
+//
+// The board also checks the firmware's use of the ports on every access,
+// since the hardware would misbehave quietly rather than fail. It reports
+// a violation when:
+//
+//   - both decoders are enabled at once
+//   - the decoder address changes while a decoder is enabled, which can
+//     glitch the outputs of the decoder
+//   - two input registers drive the I/O bus at once
+//   - an input register drives the I/O bus while any bit of the data
+//     port is an output
+//   - the data port is used, by reading it or enabling a decoder, before
+//     a delay of SETTLE_MICROS after its direction changed
+//   - the board and the device drive a socket pin at once, e.g. because
+//     the output enables in U10 were written in the wrong order
+//
+// The simulator doesn't count instruction times, so only delays count
+// toward the settling time.
+
+#include <stdlib.h>
+
+#include "board.h"
+
+SimRegister PORTB(SIM_PORTB), PORTC(SIM_PORTC), PORTD(SIM_PORTD);
+SimRegister DDRB(SIM_DDRB), DDRC(SIM_DDRC), DDRD(SIM_DDRD);
+SimRegister PINB(SIM_PINB), PINC(SIM_PINC), PIND(SIM_PIND);
+SimRegister SREG(SIM_SREG);
+
+namespace BoardPrivate {
+
+  // Decoder outputs by ID, as in port_utils.h and the cex README
+  enum : byte {
+    ID_U3_CLK = 0x0, ID_U3_OE = 0x1, ID_U2_CLK = 0x2, ID_U1_CLK = 0x3,
+    ID_U4_CLK = 0x4, ID_U5_CLK = 0x5, ID_U8_CLK = 0x6, ID_U7_CLK = 0x7,
+    ID_TSTCLK = 0x8, ID_U7_OE = 0x9, ID_U10_CLK = 0xA, ID_U11_CLK = 0xB,
+    ID_U11_OE = 0xC, ID_U14_CLK = 0xD,
+  };
+
+  const char* const idNames[16] = {
+    "U3", "U3_OE", "U2", "U1", "U4", "U5", "U8", "U7",
+    "TSTCLK", "U7_OE", "U10", "U11", "U11_OE", "U14", "E", "F",
+  };
+
+  constexpr uint16_t OUTPUT_REGISTERS = _BV(ID_U2_CLK) | _BV(ID_U1_CLK) | _BV(ID_U4_CLK) |
+    _BV(ID_U5_CLK) | _BV(ID_U8_CLK) | _BV(ID_U10_CLK) | _BV(ID_U14_CLK);
+
+  // Active low output enables in U10
+  constexpr byte U10_U1_OE = 0x80;
+  constexpr byte U10_U2_OE = 0x40;
+  constexpr byte U10_U8_OE = 0x20;
+
+  constexpr byte BOTH_ENABLES = _BV(PORTC3) | _BV(PORTC4);
+
+  Dut* dut;
+  bool verbose;
+  bool strict;
+
+  constexpr unsigned SETTLE_MICROS = 2;
+
+  byte out[16];           // output registers, by the ID of their clock
+  byte u3, u7, u11;       // input registers
+  uint16_t asserted;      // decoder outputs now asserted, by ID
+  Pins driven;            // levels the board drives on the socket
+  Pins fromDut;           // levels the device drives
+  bool contended[PLCC_PINS + 1]; // pins both drive
+
+  // Checking
+  byte portc;             // last value written to PORTC
+  byte drives;            // data port bits that are outputs
+  bool settling;          // the data port direction changed...
+  unsigned long settled;  // ...and this many microseconds have passed
+  unsigned long violations;
+
+  uint16_t decoderOutputs(byte portc) {
+    uint16_t result = 0;
+    if (portc & _BV(PORTC3)) {
+      result |= 1 << (portc & 7);
+    }
+    if (portc & _BV(PORTC4)) {
+      result |= 1 << (8 + (portc & 7));
+    }
+    return result;
+  }
+
+  // The data port value and the bits of it that the Nano drives
+  byte nanoData() {
+    return ((PORTD.value() >> 5) & 0x07) | ((PORTB.value() & 0x1F) << 3);
+  }
+
+  byte nanoDrives() {
+    return ((DDRD.value() >> 5) & 0x07) | ((DDRB.value() & 0x1F) << 3);
+  }
+
+  byte busValue() {
+    byte v = 0xFF;
+    if (asserted & _BV(ID_U3_OE)) {
+      v &= u3;
+    }
+    if (asserted & _BV(ID_U7_OE)) {
+      v &= u7;
+    }
+    if (asserted & _BV(ID_U11_OE)) {
+      v &= u11;
+    }
+    byte drives = nanoDrives();
+    return (v & ~drives) | (nanoData() & drives);
+  }
+
+  Level bitLevel(byte reg, int bit) {
+    return (reg >> bit) & 1;
+  }
+
+  bool enabled(byte oe) {
+    return (out[ID_U10_CLK] & oe) == 0;
+  }
+
+  Level tstclk() {
+    return (asserted & _BV(ID_TSTCLK)) ? L0 : L1;
+  }
+
+  void drivePLCC(Pins& p) {
+    for (int i = 0; i < 8; ++i) {
+      p.pin[1 + i] = bitLevel(out[ID_U4_CLK], i);
+      p.pin[9 + i] = bitLevel(out[ID_U5_CLK], i);
+    }
+    p.pin[17] = tstclk();
+    byte u8 = out[ID_U8_CLK];
+    if (enabled(U10_U8_OE)) {
+      p.pin[25] = bitLevel(u8, 2);
+      p.pin[26] = bitLevel(u8, 1);
+      p.pin[27] = bitLevel(u8, 0);
+      for (int i = 0; i < 5; ++i) {
+        p.pin[44 + i] = bitLevel(u8, 3 + i);
+      }
+    }
+    byte u10 = out[ID_U10_CLK];
+    for (int i = 0; i < 4; ++i) {
+      p.pin[49 + i] = bitLevel(u10, 3 - i);
+    }
+    for (int i = 0; i < 8; ++i) {
+      if (enabled(U10_U1_OE)) {
+        p.pin[53 + i] = bitLevel(out[ID_U1_CLK], i);
+      }
+      if (enabled(U10_U2_OE)) {
+        p.pin[61 + i] = bitLevel(out[ID_U2_CLK], i);
+      }
+    }
+  }
+
+  void driveZIF(Pins& p) {
+    p.pin[1] = tstclk();
+    for (int i = 0; i < 8; ++i) {
+      if (i != 0 && enabled(U10_U1_OE)) {
+        p.pin[1 + i] = bitLevel(out[ID_U1_CLK], i);
+      }
+      if (enabled(U10_U2_OE)) {
+        p.pin[9 + i] = bitLevel(out[ID_U2_CLK], i);
+      }
+      if (enabled(U10_U8_OE)) {
+        p.pin[17 + i] = bitLevel(out[ID_U8_CLK], i);
+      }
+    }
+  }
+
+  void violation(const char* what, const char* detail = "") {
+    violations++;
+    fprintf(stderr, "board: violation %lu: %s%s (PORTC 0x%02X, data port output bits 0x%02X)\n",
+            violations, what, detail, portc, drives);
+    if (strict) {
+      exit(4);
+    }
+  }
+
+  void checkSettled(const char* use) {
+    if (settling) {
+      violation(use, " before the data port direction settled");
+    }
+  }
+
+  void checkBus() {
+    const byte oes[] = {ID_U3_OE, ID_U7_OE, ID_U11_OE};
+    int n = 0;
+    for (byte id : oes) {
+      if (asserted & _BV(id)) {
+        n++;
+        if (drives != 0) {
+          violation("data port is an output while the bus is driven by ", idNames[id]);
+        }
+      }
+    }
+    if (n > 1) {
+      violation("two input registers drive the bus");
+    }
+  }
+
+  void checkSelect(byte prev, byte next) {
+    if ((next & BOTH_ENABLES) == BOTH_ENABLES) {
+      violation("both decoders enabled");
+    }
+    if (((prev ^ next) & 7) && ((prev | next) & BOTH_ENABLES)) {
+      violation("decoder address changed while a decoder is enabled");
+    }
+    if (next & ~prev & BOTH_ENABLES) {
+      checkSettled("decoder enabled");
+    }
+  }
+
+  void writeDirection() {
+    byte now = nanoDrives();
+    if (now != drives) {
+      drives = now;
+      settling = true;
+      settled = 0;
+      checkBus();
+    }
+  }
+
+  // Report each pin when the board and the device start to drive it
+  void checkContention() {
+    for (int n = 1; n <= PLCC_PINS; ++n) {
+      bool both = driven.pin[n] != LZ && fromDut.pin[n] != LZ;
+      if (both && !contended[n]) {
+        char detail[8];
+        snprintf(detail, sizeof(detail), " %d", n);
+        violation("the board and the device both drive socket pin", detail);
+      }
+      contended[n] = both;
+    }
+  }
+
+  // Recompute the levels on the socket after a change
+  void refresh() {
+    driven.clear(LZ);
+    fromDut.clear(LZ);
+    if (dut == 0) {
+      return;
+    }
+    if (dut->socket() == SOCKET_PLCC) {
+      drivePLCC(driven);
+    } else {
+      driveZIF(driven);
+    }
+    dut->update(driven, fromDut);
+    checkContention();
+  }
+
+  bool pinHigh(int n) {
+    Level l = (fromDut.pin[n] != LZ) ? fromDut.pin[n] : driven.pin[n];
+    return l != L0;
+  }
+
+  // Capture the socket in an input register. Returns the new value.
+  byte capture(byte id) {
+    bool plcc = (dut == 0 || dut->socket() == SOCKET_PLCC);
+    byte v = 0;
+    for (int i = 0; i < 8; ++i) {
+      int n;
+      switch (id) {
+      case ID_U3_CLK:  n = plcc ? 35 - i : 1 + i;  break;
+      case ID_U7_CLK:  n = plcc ? 43 - i : 9 + i;  break;
+      default:         n = plcc ? 20 + i : 17 + i; break;
+      }
+      if ((plcc && id == ID_U11_CLK && i > 4) || pinHigh(n)) {
+        v |= 1 << i;
+      }
+    }
+    return v;
+  }
+
+  // A decoder output was deasserted: its rising edge clocks a register
+  void risingEdge(byte id) {
+    if (OUTPUT_REGISTERS & _BV(id)) {
+      out[id] = busValue();
+      if (verbose) {
+        fprintf(stderr, "board: %s <- 0x%02X\n", idNames[id], out[id]);
+      }
+      refresh();
+    } else if (id == ID_U3_CLK || id == ID_U7_CLK || id == ID_U11_CLK) {
+      byte v = capture(id);
+      switch (id) {
+      case ID_U3_CLK: u3 = v; break;
+      case ID_U7_CLK: u7 = v; break;
+      default:        u11 = v; break;
+      }
+      if (verbose) {
+        fprintf(stderr, "board: %s captured 0x%02X\n", idNames[id], v);
+      }
+    }
+  }
+
+  void writeSelect(byte next) {
+    byte prev = portc;
+    portc = next;
+    checkSelect(prev, next);
+    uint16_t now = decoderOutputs(next);
+    uint16_t deasserted = asserted & ~now;
+    uint16_t changed = asserted ^ now;
+    asserted = now;
+    checkBus();
+    for (byte id = 0; id < 16; ++id) {
+      if (deasserted & _BV(id)) {
+        risingEdge(id);
+      }
+    }
+    if (changed & _BV(ID_TSTCLK)) {
+      refresh();
+    }
+  }
+}
+
+void boardAttach(Dut* dut) {
+  // The registers power up in an unknown state. Take U10 to be all high,
+  // with its output enables off, rather than report contention that only
+  // the firmware's initialization can prevent.
+  BoardPrivate::out[BoardPrivate::ID_U10_CLK] = 0xFF;
+  BoardPrivate::dut = dut;
+  BoardPrivate::refresh();
+}
+
+void boardSetVerbose(bool verbose) {
+  BoardPrivate::verbose = verbose;
+}
+
+void boardSetStrict(bool strict) {
+  BoardPrivate::strict = strict;
+}
+
+void boardDelay(unsigned long us) {
+  using namespace BoardPrivate;
+  if (settling) {
+    settled += us;
+    settling = settled < SETTLE_MICROS;
+  }
+}
+
+unsigned long boardViolations() {
+  return BoardPrivate::violations;
+}
+
+byte simReadRegister(SimRegId id, byte value) {
+  switch (id) {
+  case SIM_PINB:
+    BoardPrivate::checkSettled("data port read");
+    return (PORTB.value() & 0xE0) | (BoardPrivate::busValue() >> 3);
+  case SIM_PIND:
+    BoardPrivate::checkSettled("data port read");
+    return (PORTD.value() & 0x1F) | ((BoardPrivate::busValue() & 0x07) << 5);
+  case SIM_PINC:
+    return PORTC.value();
+  default:
+    return value;
+  }
+}
+
+void simWriteRegister(SimRegId id, byte value) {
+  switch (id) {
+  case SIM_PORTC:
+    BoardPrivate::writeSelect(value);
+    break;
+  case SIM_DDRB:
+  case SIM_DDRD:
+    BoardPrivate::writeDirection();
+    break;
+  default:
+    break;
+  }
+}
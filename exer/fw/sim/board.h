@@ -0,0 +1,28 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+//
+// Model of the exerciser board outside the Nano: the two 74HC138
+// decoders, the output registers U1, U2, U4, U5, U8, and U10 that drive
+// the sockets, and the input registers U3, U7, and U11 that capture the
+// sockets and drive the Nano's I/O bus. See port_utils.h for how the
+// firmware drives them, and board.cpp for the socket wiring.
+
+#pragma once
+
+#include "Arduino.h"
+#include "dut.h"
+
+// Put dut in its socket. Null removes it.
+void boardAttach(Dut* dut);
+
+// Report board activity on stderr.
+void boardSetVerbose(bool verbose);
+
+// Exit with status 4 at the first violation of the port rules (see
+// board.cpp) instead of reporting it and going on.
+void boardSetStrict(bool strict);
+
+// The firmware delayed for us microseconds.
+void boardDelay(unsigned long us);
+
+// The number of violations reported so far.
+unsigned long boardViolations();
@@ -0,0 +1,39 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+//
+// Registry of device under test models.
+
+#include "dut.h"
+
+namespace DutPrivate {
+  // The head of the list. Registrations are static objects in the model
+  // files, so this is initialized (to zero) before any of them.
+  DutRegistration* registered;
+}
+
+DutRegistration::DutRegistration(const char* name, const char* help, DutFactory make)
+    : name(name), help(help), make(make), next(DutPrivate::registered) {
+  DutPrivate::registered = this;
+}
+
+Dut* makeDut(const std::string& spec, std::string& err) {
+  std::string name = spec;
+  std::string arg;
+  size_t colon = spec.find(':');
+  if (colon != std::string::npos) {
+    name = spec.substr(0, colon);
+    arg = spec.substr(colon + 1);
+  }
+  for (DutRegistration* r = DutPrivate::registered; r != 0; r = r->next) {
+    if (name == r->name) {
+      return r->make(arg, err);
+    }
+  }
+  err = "no such model: " + name;
+  return 0;
+}
+
+void listDuts(FILE* f) {
+  for (DutRegistration* r = DutPrivate::registered; r != 0; r = r->next) {
+    fprintf(f, "  %-10s %s\n", r->name, r->help);
+  }
+}
@@ -0,0 +1,80 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+//
+// The device under test (DUT) plug-in interface for the simulator.
+//
+// A DUT model sits in one of the exerciser's two sockets. The board model
+// (board.h) works out the level it drives on each socket pin from the
+// output registers and the decoders, and calls the model's update() with
+// them whenever any of them change. The model returns the levels it drives
+// on its output pins, which the input registers capture when clocked. A
+// model sees clock edges as changes between one call and the next; it
+// must not assume it's called only when a particular pin changes.
+//
+// Models register themselves by name with a static DutRegistration in
+// their own source file, so adding a model only means adding a file to
+// the Makefile. The simulator's command line names one model and passes
+// it an optional argument, e.g. "22v10:counter.jed".
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+// The level on a pin. Pins nobody drives are LZ.
+typedef int8_t Level;
+constexpr Level L0 = 0;
+constexpr Level L1 = 1;
+constexpr Level LZ = -1;
+
+enum Socket { SOCKET_PLCC, SOCKET_ZIF };
+
+constexpr int PLCC_PINS = 68;
+constexpr int ZIF_PINS = 24;   // as numbered in ZIF vectors
+
+// Pin levels indexed by pin number, 1..PLCC_PINS or 1..ZIF_PINS.
+// Element 0 is unused.
+struct Pins {
+  Level pin[PLCC_PINS + 1];
+
+  void clear(Level l) {
+    for (int i = 0; i <= PLCC_PINS; ++i) {
+      pin[i] = l;
+    }
+  }
+
+  // Inputs that aren't driven float high, as TTL inputs do.
+  bool high(int n) const {
+    return pin[n] != L0;
+  }
+};
+
+class Dut {
+ public:
+  virtual ~Dut() {}
+  virtual const char* name() const = 0;
+  virtual Socket socket() const = 0;
+
+  // The board drives the levels in in. Set out to the levels the device
+  // drives, and LZ on the pins it doesn't drive.
+  virtual void update(const Pins& in, Pins& out) = 0;
+};
+
+// A model's factory. The argument is the part of the model specification
+// after the colon, or empty. On failure, return null and set err.
+typedef Dut* (*DutFactory)(const std::string& arg, std::string& err);
+
+struct DutRegistration {
+  const char* name;
+  const char* help;
+  DutFactory make;
+  DutRegistration* next;
+
+  DutRegistration(const char* name, const char* help, DutFactory make);
+};
+
+// Create the model named by spec ("name" or "name:arg").
+Dut* makeDut(const std::string& spec, std::string& err);
+
+// List the registered models on f.
+void listDuts(FILE* f);
@@ -0,0 +1,240 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+//
+// Model of a 22V10 GAL (e.g. ATF22V10C) in the ZIF socket, programmed
+// from a JEDEC fuse file such as galasm produces from a .pld file.
+//
+// Fuse map (5892 fuses): rows of 44 fuses, one per product term. Row 0
+// is the asynchronous reset term. Then for each output macrocell (OLMC)
+// from pin 23 down to pin 14, an output enable term followed by 8, 10,
+// 12, 14, 16, 16, 14, 12, 10, and 8 sum terms. Row 131 is the synchronous
+// preset term. Fuses 5808..5827 are the S0 and S1 bits of each OLMC, in
+// the same order, and the rest are the user electronic signature.
+//
+// The columns of a row are the true and complement of pin 1, the feedback
+// from pin 23, pin 2, the feedback from pin 22, and so on to pin 11 and
+// the feedback from pin 14, and last pin 13. A 0 fuse (intact) connects
+// the column to the product term. A term with every fuse intact is false
+// and one with every fuse blown is true.
+//
+// S1 is 0 for a registered output and 1 for a combinational one; S0 is
+// 1 for active high. A registered OLMC feeds back the inverted output of
+// its register, and a combinational one feeds back its pin. Pin 1 is the
+// register clock. The registers are reset at power up.
+
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "dut.h"
+
+namespace {
+
+  constexpr int FUSES = 5892;
+  constexpr int COLUMNS = 44;
+  constexpr int SP_ROW = 131;
+  constexpr int S_FUSES = 5808;
+  constexpr int OLMCS = 10;
+  constexpr int TERMS[OLMCS] = {8, 10, 12, 14, 16, 16, 14, 12, 10, 8};
+
+  int olmcPin(int i) {
+    return 23 - i;
+  }
+
+  // The pins whose true and complement are the columns 2k and 2k+1
+  constexpr int COLUMN_PINS[COLUMNS / 2] = {
+    1, 23, 2, 22, 3, 21, 4, 20, 5, 19, 6, 18, 7, 17, 8, 16, 9, 15, 10, 14, 11, 13,
+  };
+
+  class GAL22V10 : public Dut {
+   public:
+    explicit GAL22V10(const std::vector<bool>& fuses);
+
+    const char* name() const override { return "22v10"; }
+    Socket socket() const override { return SOCKET_ZIF; }
+    void update(const Pins& in, Pins& out) override;
+
+   private:
+    bool term(int row, const bool* signal) const;
+    bool sum(int i, const bool* signal) const;
+    void signals(const Pins& in, const Pins& out, bool* signal) const;
+
+    std::vector<bool> fuse;
+    int firstRow[OLMCS];  // output enable row of each OLMC
+    bool registered[OLMCS];
+    bool activeHigh[OLMCS];
+    bool q[OLMCS];        // register outputs
+    bool clk = true;
+  };
+
+  GAL22V10::GAL22V10(const std::vector<bool>& fuses) : fuse(fuses) {
+    int row = 1;
+    for (int i = 0; i < OLMCS; ++i) {
+      firstRow[i] = row;
+      row += 1 + TERMS[i];
+      activeHigh[i] = fuse[S_FUSES + 2 * i];
+      registered[i] = !fuse[S_FUSES + 2 * i + 1];
+      q[i] = false;
+    }
+  }
+
+  bool GAL22V10::term(int row, const bool* signal) const {
+    int base = row * COLUMNS;
+    for (int c = 0; c < COLUMNS; ++c) {
+      if (fuse[base + c]) {
+        continue;
+      }
+      bool v = signal[c / 2];
+      if ((c & 1) ? v : !v) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool GAL22V10::sum(int i, const bool* signal) const {
+    for (int t = 1; t <= TERMS[i]; ++t) {
+      if (term(firstRow[i] + t, signal)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // The value of the signal of each column pair: the input pins, the
+  // register feedback of registered OLMCs, or the pin of combinational
+  // ones, driven either by the OLMC (in out) or by the board (in in).
+  void GAL22V10::signals(const Pins& in, const Pins& out, bool* signal) const {
+    for (int k = 0; k < COLUMNS / 2; ++k) {
+      int pin = COLUMN_PINS[k];
+      if (pin >= 14 && pin <= 23) {
+        int i = 23 - pin;
+        if (registered[i]) {
+          signal[k] = !q[i];
+          continue;
+        }
+        if (out.pin[pin] != LZ) {
+          signal[k] = out.pin[pin];
+          continue;
+        }
+      }
+      signal[k] = in.high(pin);
+    }
+  }
+
+  void GAL22V10::update(const Pins& in, Pins& out) {
+    bool signal[COLUMNS / 2];
+
+    // Registers first: on the rising edge of pin 1, each loads its sum
+    // of products as it was before the edge, or 1 if the synchronous
+    // preset term is true.
+    bool newClk = in.high(1);
+    if (newClk && !clk) {
+      signals(in, out, signal);
+      bool preset = term(SP_ROW, signal);
+      bool next[OLMCS];
+      for (int i = 0; i < OLMCS; ++i) {
+        next[i] = preset || sum(i, signal);
+      }
+      for (int i = 0; i < OLMCS; ++i) {
+        q[i] = next[i];
+      }
+    }
+    clk = newClk;
+
+    // Then the outputs. Combinational outputs may feed back into each
+    // other, so iterate until they settle (or give up and leave them).
+    for (int pass = 0; pass < 2 * OLMCS; ++pass) {
+      signals(in, out, signal);
+      if (term(0, signal)) {
+        for (int i = 0; i < OLMCS; ++i) {
+          q[i] = false;
+        }
+      }
+      bool changed = false;
+      for (int i = 0; i < OLMCS; ++i) {
+        Level l = LZ;
+        if (term(firstRow[i], signal)) {
+          bool v = registered[i] ? q[i] : sum(i, signal);
+          l = (v == activeHigh[i]) ? L1 : L0;
+        }
+        int pin = olmcPin(i);
+        if (out.pin[pin] != l) {
+          out.pin[pin] = l;
+          changed = true;
+        }
+      }
+      if (!changed) {
+        break;
+      }
+    }
+  }
+
+  // Parse a JEDEC file. Only the QF (fuse count), F (default fuse state),
+  // and L (fuse list) fields matter; the rest are ignored.
+  bool parseJedec(const std::string& text, std::vector<bool>& fuses, std::string& err) {
+    size_t start = text.find('\x02');
+    size_t end = text.find('\x03');
+    start = (start == std::string::npos) ? 0 : start + 1;
+    std::string body = text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+
+    fuses.assign(FUSES, false);
+    std::stringstream fields(body);
+    std::string field;
+    bool first = true;
+    while (std::getline(fields, field, '*')) {
+      size_t i = field.find_first_not_of(" \t\r\n");
+      if (first) {
+        first = false; // the design specification, free text
+        continue;
+      }
+      if (i == std::string::npos) {
+        continue;
+      }
+      field = field.substr(i);
+      if (field.compare(0, 2, "QF") == 0) {
+        if (atoi(field.c_str() + 2) != FUSES) {
+          err = "not a 22V10 fuse map: " + field;
+          return false;
+        }
+      } else if (field[0] == 'F') {
+        fuses.assign(FUSES, field[1] == '1');
+      } else if (field[0] == 'L') {
+        char* bits;
+        long addr = strtol(field.c_str() + 1, &bits, 10);
+        for (; *bits; ++bits) {
+          if (*bits == '0' || *bits == '1') {
+            if (addr >= FUSES) {
+              err = "fuse address out of range";
+              return false;
+            }
+            fuses[addr++] = (*bits == '1');
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+  Dut* make22V10(const std::string& arg, std::string& err) {
+    if (arg.empty()) {
+      err = "22v10 requires a JEDEC file, e.g. 22v10:counter.jed";
+      return 0;
+    }
+    std::ifstream f(arg);
+    if (!f) {
+      err = "can't open " + arg;
+      return 0;
+    }
+    std::stringstream text;
+    text << f.rdbuf();
+    std::vector<bool> fuses;
+    if (!parseJedec(text.str(), fuses, err)) {
+      err = arg + ": " + err;
+      return 0;
+    }
+    return new GAL22V10(fuses);
+  }
+
+  DutRegistration registration("22v10", "22V10 GAL programmed from a JEDEC fuse file (ZIF), 22v10:file.jed", make22V10);
+}
@@ -0,0 +1,133 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+//
+// Behavioral model of the Logic Devices L4C381 16-bit ALU in the PLCC
+// socket. Pin assignments are those of the vector files (see t.tv):
+//
+//   1..16   A<15:0> inputs, pin 1 is A0
+//   17      CLK; registers load on the rising edge
+//   20..24  C (carry out), P# and G# (carry propagate and generate,
+//           active low), Z (zero), V (overflow) outputs
+//   25      ENF#, F register load enable
+//   26      FTF, F register flow through
+//   27      OE#, F output enable
+//   28..43  F<15:0> outputs, bit reversed: pin 28 is F15
+//   44      Cin
+//   45..47  S0..S2, function select
+//   48, 49  OSA, OSB, operand select; low selects the F register
+//   50      FTAB, A and B register flow through
+//   51, 52  ENB#, ENA#, B and A register load enables
+//   53..68  B<15:0> inputs, pin 53 is B0
+//
+// The functions, by S2..S0, are CLEAR, NOT(A) + B, A + NOT(B), A + B,
+// XOR, OR, AND, and SET; the sums include Cin. The flags are always
+// driven and follow the ALU, not the F register.
+
+#include "dut.h"
+
+namespace {
+
+  class L4C381 : public Dut {
+   public:
+    const char* name() const override { return "l4c381"; }
+    Socket socket() const override { return SOCKET_PLCC; }
+    void update(const Pins& in, Pins& out) override;
+
+   private:
+    struct Result {
+      uint16_t f;
+      bool c, p, g, v;
+    };
+
+    static uint16_t word(const Pins& in, int firstPin);
+    Result alu(const Pins& in) const;
+
+    uint16_t regA = 0;
+    uint16_t regB = 0;
+    uint16_t regF = 0;
+    bool clk = true;
+  };
+
+  uint16_t L4C381::word(const Pins& in, int firstPin) {
+    uint16_t w = 0;
+    for (int i = 0; i < 16; ++i) {
+      if (in.high(firstPin + i)) {
+        w |= 1 << i;
+      }
+    }
+    return w;
+  }
+
+  L4C381::Result L4C381::alu(const Pins& in) const {
+    bool ftab = in.high(50);
+    uint16_t a = ftab ? word(in, 1) : regA;
+    uint16_t b = ftab ? word(in, 53) : regB;
+    if (!in.high(48)) {
+      a = regF;
+    }
+    if (!in.high(49)) {
+      b = regF;
+    }
+    int select = in.high(45) | (in.high(46) << 1) | (in.high(47) << 2);
+    unsigned cin = in.high(44);
+
+    Result r = {0, false, false, false, false};
+    uint16_t x = a, y = b;
+    switch (select) {
+    case 0: r.f = 0;                    return r;
+    case 1: x = ~a;                     break;
+    case 2: y = ~b;                     break;
+    case 3:                             break;
+    case 4: r.f = a ^ b;                return r;
+    case 5: r.f = a | b;                return r;
+    case 6: r.f = a & b;                return r;
+    case 7: r.f = 0xFFFF;               return r;
+    }
+    uint32_t sum = uint32_t(x) + y + cin;
+    r.f = sum;
+    r.c = (sum >> 16) != 0;
+    r.g = ((uint32_t(x) + y) >> 16) != 0;
+    r.p = uint16_t(x | y) == 0xFFFF;
+    r.v = ((x ^ r.f) & (y ^ r.f) & 0x8000) != 0;
+    return r;
+  }
+
+  void L4C381::update(const Pins& in, Pins& out) {
+    Result r = alu(in);
+
+    bool newClk = in.high(17);
+    if (newClk && !clk) {
+      if (!in.high(25)) {
+        regF = r.f;
+      }
+      if (!in.high(52)) {
+        regA = word(in, 1);
+      }
+      if (!in.high(51)) {
+        regB = word(in, 53);
+      }
+      r = alu(in);
+    }
+    clk = newClk;
+
+    out.pin[20] = r.c;
+    out.pin[21] = !r.p;
+    out.pin[22] = !r.g;
+    out.pin[23] = (r.f == 0);
+    out.pin[24] = r.v;
+
+    uint16_t f = in.high(26) ? r.f : regF;
+    for (int i = 0; i < 16; ++i) {
+      out.pin[43 - i] = in.high(27) ? LZ : Level((f >> i) & 1);
+    }
+  }
+
+  Dut* makeL4C381(const std::string& arg, std::string& err) {
+    if (!arg.empty()) {
+      err = "l4c381 takes no argument";
+      return 0;
+    }
+    return new L4C381();
+  }
+
+  DutRegistration registration("l4c381", "Logic Devices L4C381 16-bit ALU (PLCC)", makeL4C381);
+}
@@ -0,0 +1,7 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+//
+// The firmware, built for the simulator. The Arduino IDE includes
+// Arduino.h implicitly; here it's the simulator's version.
+
+#include "Arduino.h"
+#include "../fw.ino"
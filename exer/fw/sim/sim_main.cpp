@@ -0,0 +1,255 @@
+// Copyright (c) Jeff Berkowitz 2021, 2022. All rights reserved.
+//
+// Host simulator for the exerciser firmware.
+//
+// The firmware runs unchanged against a model of the exerciser board
+// (board.cpp) with an optional device under test in one of its sockets
+// (dut.h). The Nano's USB serial port is a pseudo-terminal. Its name is
+// printed at startup and may also be given a fixed name with -p, so cex
+// can be pointed at it with its -port flag:
+//
+//   sim -p /tmp/nano l4c381 &
+//   cex -port /tmp/nano t.tv
+//
+// Time runs at host speed, except that delays return at once and add to
+// the simulated time reported by millis() and micros().
+//
+// The board model checks the firmware's use of the ports and reports
+// violations on stderr; -s makes the first one fatal. On SIGINT or
+// SIGTERM the simulator reports the number of violations and exits
+// with status 4 if there were any.
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "Arduino.h"
+#include "board.h"
+#include "dut.h"
+
+// In fw.ino
+void setup();
+void loop();
+
+SimSerial Serial;
+
+namespace SimPrivate {
+  const char* linkPath;     // -p
+  bool verbose;             // -v
+  bool strict;              // -s
+  volatile sig_atomic_t stopping;
+  int master = -1;          // our side of the pseudo-terminal
+
+  // Time
+  struct timespec start;
+  unsigned long skewMicros; // added by delays
+
+  // The Arduino core's receive buffer
+  byte rxBuf[SERIAL_RX_BUFFER_SIZE];
+  int rxHead, rxTail, rxCount;
+  unsigned long overruns;
+  int idlePolls;
+
+  unsigned long hostMicros() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) * 1000000UL + (now.tv_nsec - start.tv_nsec) / 1000;
+  }
+
+  void removeLink() {
+    if (linkPath != 0) {
+      unlink(linkPath);
+    }
+  }
+
+  void stop(int) {
+    stopping = 1;
+  }
+
+  // The firmware's loop() never returns, so this is called from the
+  // serial port, which the firmware polls continuously.
+  void finish() {
+    unsigned long violations = boardViolations();
+    fprintf(stderr, "sim: %lu violation(s)\n", violations);
+    exit(violations == 0 ? 0 : 4);
+  }
+
+  // Move whatever the host has sent into the receive buffer. Bytes that
+  // don't fit are lost, as they are when the Nano's buffer overflows.
+  // When nothing has arrived for a while, wait a little in poll() rather
+  // than spinning.
+  void receive() {
+    if (stopping) {
+      finish();
+    }
+    if (rxCount == 0 && ++idlePolls > 10000) {
+      struct pollfd pfd = {master, POLLIN, 0};
+      poll(&pfd, 1, 1);
+    }
+    byte buf[256];
+    ssize_t n = read(master, buf, sizeof(buf));
+    if (n <= 0) {
+      return;
+    }
+    idlePolls = 0;
+    int lost = 0;
+    for (ssize_t i = 0; i < n; ++i) {
+      if (rxCount == SERIAL_RX_BUFFER_SIZE) {
+        lost++;
+        continue;
+      }
+      rxBuf[rxHead] = buf[i];
+      rxHead = (rxHead + 1) % SERIAL_RX_BUFFER_SIZE;
+      rxCount++;
+    }
+    if (lost != 0) {
+      overruns += lost;
+      fprintf(stderr, "sim: receive buffer overrun: %d bytes lost (%lu total)\n", lost, overruns);
+    }
+  }
+
+  void usage() {
+    fprintf(stderr, "usage: sim [-lsv] [-p link] [model[:arg]]\nmodels:\n");
+    listDuts(stderr);
+    exit(2);
+  }
+}
+
+void SimSerial::begin(long baud) {
+  using namespace SimPrivate;
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    perror("sim: pseudo-terminal");
+    exit(1);
+  }
+  const char* name = ptsname(master);
+
+  // Hold the other side open so reads don't fail between host sessions,
+  // and make it raw in case the host doesn't.
+  int slave = open(name, O_RDWR | O_NOCTTY);
+  struct termios tio;
+  if (slave < 0 || tcgetattr(slave, &tio) != 0) {
+    perror("sim: pseudo-terminal");
+    exit(1);
+  }
+  cfmakeraw(&tio);
+  tcsetattr(slave, TCSANOW, &tio);
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+  if (linkPath != 0) {
+    unlink(linkPath);
+    if (symlink(name, linkPath) != 0) {
+      perror(linkPath);
+      exit(1);
+    }
+    atexit(removeLink);
+  }
+  fprintf(stderr, "sim: serial port %s%s%s, %ld baud\n", name,
+          linkPath ? " linked as " : "", linkPath ? linkPath : "", baud);
+}
+
+int SimSerial::available() {
+  SimPrivate::receive();
+  return SimPrivate::rxCount;
+}
+
+int SimSerial::read() {
+  using namespace SimPrivate;
+  if (rxCount == 0) {
+    return -1;
+  }
+  byte b = rxBuf[rxTail];
+  rxTail = (rxTail + 1) % SERIAL_RX_BUFFER_SIZE;
+  rxCount--;
+  return b;
+}
+
+// Like the Nano's, the transmit side never blocks: when the host isn't
+// reading, there's no room and the firmware waits for it.
+int SimSerial::availableForWrite() {
+  struct pollfd pfd = {SimPrivate::master, POLLOUT, 0};
+  return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLOUT) ? 1 : 0;
+}
+
+size_t SimSerial::write(uint8_t b) {
+  return ::write(SimPrivate::master, &b, 1) == 1 ? 1 : 0;
+}
+
+void pinMode(int pin, int mode) {
+}
+
+void digitalWrite(int pin, int value) {
+}
+
+void delay(unsigned long ms) {
+  SimPrivate::skewMicros += ms * 1000;
+  boardDelay(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  SimPrivate::skewMicros += us;
+  boardDelay(us);
+}
+
+unsigned long micros() {
+  return SimPrivate::hostMicros() + SimPrivate::skewMicros;
+}
+
+unsigned long millis() {
+  return micros() / 1000;
+}
+
+byte TCCR1A;
+byte TCCR1B;
+
+uint16_t simTimer1() {
+  return uint16_t(micros() * 16);
+}
+
+void simPanic(byte panicCode, byte subcode) {
+  fprintf(stderr, "sim: panic 0x%02X subcode 0x%02X\n", panicCode, subcode);
+  exit(3);
+}
+
+int main(int argc, char** argv) {
+  using namespace SimPrivate;
+  int opt;
+  while ((opt = getopt(argc, argv, "lp:sv")) != -1) {
+    switch (opt) {
+    case 'l': listDuts(stdout); exit(0);
+    case 'p': linkPath = optarg; break;
+    case 's': strict = true; break;
+    case 'v': verbose = true; break;
+    default:  usage();
+    }
+  }
+  if (optind < argc - 1) {
+    usage();
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  boardSetVerbose(verbose);
+  boardSetStrict(strict);
+  if (optind < argc) {
+    std::string err;
+    Dut* dut = makeDut(argv[optind], err);
+    if (dut == 0) {
+      fprintf(stderr, "sim: %s\n", err.c_str());
+      usage();
+    }
+    boardAttach(dut);
+    fprintf(stderr, "sim: %s in the %s socket\n", dut->name(),
+            dut->socket() == SOCKET_PLCC ? "PLCC" : "ZIF");
+  }
+
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  setup();
+  loop();
+}
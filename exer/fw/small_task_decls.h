@@ -6,10 +6,12 @@
 void hbIncIterationCount();
 
 // The task runner sets this when a task runs for a long time,
-// and the heartbeat sets it back to 1. We default to 1, not
-// zero, because milliseconds can increment during even a short
-// task execution. So only values greater than 1 are interesting.
-extern int hbLongestTask;
+// and the heartbeat sets it back to 0. It's in time base ticks.
+extern Ticks hbLongestTask;
+
+// Note that the serial task took the given ticks to handle the
+// command byte cmd, so the heartbeat can report the slowest.
+void hbCommandTime(byte cmd, Ticks ticks);
 
 // Management task for Nano's on-board LED
 
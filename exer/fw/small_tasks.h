@@ -12,6 +12,8 @@ namespace HeartbeatPrivate {
   
   unsigned long hbLastHeartbeatMillis = 0;
   unsigned long hbTaskIterations = 0;
+  Ticks hbLongestCommand = 0;
+  byte hbLongestCommandByte = 0;
   
   // Queued for callback by the heartbeat task, called back from the
   // serial task next time the host requests a message.
@@ -46,11 +48,14 @@ namespace HeartbeatPrivate {
   
     // snprintf_P returns "...the number of characters that would have been written to s if there were enough space."
     // http://www.nongnu.org/avr-libc/user-manual/group__avr__stdio.html#ga53ff61856759709eeceae10aaa10a0a3
-    int result = snprintf_P(bp, bmax, PSTR("Up %02d:%02d:%02d:%02d.%03d, about %ld task/ms, max %dms"),
-               days, hours, minutes, seconds, ms, hbTaskIterations / elapsed, hbLongestTask);
+    int result = snprintf_P(bp, bmax, PSTR("Up %02d:%02d:%02d:%02d.%03d, about %ld task/ms, max %luus, command 0x%02X %luus"),
+               days, hours, minutes, seconds, ms, hbTaskIterations / elapsed, hbLongestTask / TICKS_PER_MICRO,
+               hbLongestCommandByte, hbLongestCommand / TICKS_PER_MICRO);
     if (result > bmax) result = bmax;
     hbTaskIterations = 0;
-    hbLongestTask = 1;
+    hbLongestTask = 0;
+    hbLongestCommand = 0;
+    hbLongestCommandByte = 0;
     return result;
   }
 }
@@ -58,10 +63,16 @@ namespace HeartbeatPrivate {
 // Public interface to heartbeat task
 
 // The task runner sets this to the longest task execution between
-// heartbeats, and the heartbeat code (above) sets it back to 1.
-// The value of 1 isn't interesting because milliseconds can click
-// over from N to N+1 during any task execution.
-int hbLongestTask = 1;
+// heartbeats, in ticks, and the heartbeat code (above) sets it back
+// to 0. The serial task similarly reports the longest command.
+Ticks hbLongestTask = 0;
+
+void hbCommandTime(byte cmd, Ticks ticks) {
+  if (ticks > HeartbeatPrivate::hbLongestCommand) {
+    HeartbeatPrivate::hbLongestCommand = ticks;
+    HeartbeatPrivate::hbLongestCommandByte = cmd;
+  }
+}
 
 // The HB task tracks iterations so it can log the number of task
 // executions in the recent past.
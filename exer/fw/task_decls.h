@@ -53,6 +53,29 @@ enum : byte { // including panic codes
 
 void panic(byte panicCode, byte subcode);
 
+// The time base. Timer1 counts at clk/8, two ticks a microsecond, and
+// its overflow interrupt extends the count to 32 bits. So the time wraps
+// every 35 minutes or so, and times must be compared only by their
+// difference: timeReached() for a deadline, and t1 - t0 for a duration.
+// millis() and micros() remain for times that are shown to people.
+
+typedef unsigned long Ticks;
+
+constexpr Ticks TICKS_PER_MICRO = 2;
+constexpr Ticks TICKS_PER_MILLI = 1000 * TICKS_PER_MICRO;
+
+// Return the time in ticks.
+Ticks timeNow();
+
+// Return true if the time is at or after the deadline, which must be
+// within a quarter of an hour either way of now.
+bool timeReached(Ticks deadline);
+
+// Stop the time base and return the time, so Timer1 can be used for
+// something else; and start it again from the given time.
+Ticks timeStop();
+void timeStart(Ticks now);
+
 // Convert two bytes to short, being careful about sign extension
 #define BtoS(bh, bl) (((unsigned short)(bh) << 8) | (unsigned char)(bl))
 // Convert the high byte of a short to byte, careful about sign extension
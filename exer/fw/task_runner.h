@@ -4,8 +4,6 @@
 // after all the tasks themselves. The definitions required
 // to create a task are in task_decls.h.
 
-// TODO millisecond overflow after a couple of months.
-
 namespace TaskPrivate {
 
   typedef struct ti {
@@ -32,8 +30,67 @@ namespace TaskPrivate {
   const int N_TASKS = (sizeof(Tasks) / sizeof(TaskInfo));
 
   // Store the time of next run for each task in a parallel array
-  // because the Tasks array is in ROM (PROGMEM).
-  unsigned long nextRunMillis[N_TASKS];
+  // because the Tasks array is in ROM (PROGMEM). Times are time base
+  // ticks, and a task's time is compared with timeReached(), so the
+  // comparison survives the wrap.
+  Ticks nextRun[N_TASKS];
+
+  // The time base. Timer1 runs in normal mode at clk/8, and its
+  // overflow interrupt, every 32.768ms, counts the high 16 bits of the
+  // time. The simulator has no interrupts, so there the time base is
+  // just micros().
+  volatile ushort timeHigh;
+}
+
+#ifndef EXER_SIM
+ISR(TIMER1_OVF_vect) {
+  TaskPrivate::timeHigh++;
+}
+#endif
+
+Ticks timeNow() {
+#ifdef EXER_SIM
+  return micros() * TICKS_PER_MICRO;
+#else
+  byte sreg = SREG;
+  cli();
+  ushort high = TaskPrivate::timeHigh;
+  ushort low = TCNT1;
+  // If the timer has overflowed since interrupts were masked, the
+  // overflow hasn't been counted yet.
+  if ((TIFR1 & _BV(TOV1)) && low < 0x8000) {
+    high++;
+  }
+  SREG = sreg;
+  return (Ticks(high) << 16) | low;
+#endif
+}
+
+bool timeReached(Ticks deadline) {
+  return long(timeNow() - deadline) >= 0;
+}
+
+Ticks timeStop() {
+  Ticks now = timeNow();
+#ifndef EXER_SIM
+  TIMSK1 &= ~_BV(TOIE1);
+#endif
+  return now;
+}
+
+void timeStart(Ticks now) {
+#ifndef EXER_SIM
+  byte sreg = SREG;
+  cli();
+  TCCR1B = 0;
+  TCCR1A = 0;
+  TCNT1 = now & 0xFFFF;
+  TaskPrivate::timeHigh = now >> 16;
+  TIFR1 = _BV(TOV1);
+  TIMSK1 |= _BV(TOIE1);
+  TCCR1B = _BV(CS11);
+  SREG = sreg;
+#endif
 }
 
 // A few public utilities, in order to avoid further expanding
@@ -46,6 +103,9 @@ namespace TaskPrivate {
 // of all, so in the very worst case,it stays on solid.
 
 void panic(byte panicCode, byte subcode) {
+#ifdef EXER_SIM
+  simPanic(panicCode, subcode);
+#endif
   pinMode(LED_PIN, OUTPUT);
   digitalWrite(LED_PIN, HIGH);
   
@@ -79,9 +139,10 @@ void InitTasks() {
 
   // Ideally, would snapshot the time here, and log a message if
   // the time from here to postInit() is more than 0.1s or so.
+  timeStart(0);
   
   for (int i = 0; i < TaskPrivate::N_TASKS; ++i) {
-    TaskPrivate::nextRunMillis[i] = 0;
+    TaskPrivate::nextRun[i] = 0;
     
     const TaskInit init = pgm_read_ptr_near(&TaskPrivate::Tasks[i].initialize);
     if (init != 0) {
@@ -95,16 +156,17 @@ void InitTasks() {
 }
 
 void RunTasks() {
-  unsigned long start = millis();
+  Ticks start = timeNow();
   hbIncIterationCount();
   for (int i = 0; i < TaskPrivate::N_TASKS; ++i) {
     const TaskBody body = pgm_read_ptr_near(&TaskPrivate::Tasks[i].execute);
-    if (body != 0 && start >= TaskPrivate::nextRunMillis[i]) {
-      unsigned long before = millis();
-      TaskPrivate::nextRunMillis[i] = start + body();
-      unsigned long after = millis();
+    if (body != 0 && long(start - TaskPrivate::nextRun[i]) >= 0) {
+      Ticks before = timeNow();
+      int delayMillis = body();
+      Ticks after = timeNow();
+      TaskPrivate::nextRun[i] = start + delayMillis * TICKS_PER_MILLI;
       
-      int len;
+      Ticks len;
       if ((len = after - before) > hbLongestTask) {
         hbLongestTask = len;
       }